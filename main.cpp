@@ -1,12 +1,35 @@
 #include <opencv2/opencv.hpp>
 #include <SDL2/SDL.h>
 #include <vector>
+#include <deque>
 #include <string>
 #include <ctime>
 #include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
 #include <numeric>
 #include <random>
 #include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#include <immintrin.h>
+#endif
 
 using namespace cv;
 using namespace std;
@@ -26,17 +49,90 @@ struct ConfiguracionJuego {
     int    fotogramasCambioColor    = 600;      // fotogramas entre cambios de color (y velocidad)
 
     // === Autómata Celular ===
+    double tamanoCelda      = 120.0;    // lado de cada celda (píxeles)
     double tasaEspontanea   = 0.002;    // probabilidad por actualización de nacimiento espontáneo de célula
 
     // === Jugador e Ítems ===
     float  radioJugador      = 40.0f;    // radio de colisión
     float  radioItem         = 25.0f;    // radio de ítem recuperable
+    int    capacidadItems    = 65536;    // ítems vivos como máximo; al llenarse no se generan más
 
     // === Pantalla ===
     int    fotogramasMostrarTitulo = 300;      // fotogramas para mostrar el título
     int    fotogramasMostrarNivel  = 180;      // fotogramas para mostrar “Nivel N”
 };
 
+// Los campos de la configuración, con su nombre, en un orden fijo. Uno nuevo
+// va al final y sube versionGrabacion.
+template <class C, class F>
+static void camposConfiguracion(C& c, F f) {
+    f("gravedad", c.gravedad); f("friccionSuelo", c.friccionSuelo); f("friccionAire", c.friccionAire);
+    f("velocidadMovimiento", c.velocidadMovimiento); f("velocidadSalto", c.velocidadSalto);
+    f("velocidadDesplazamiento", c.velocidadDesplazamiento); f("incrementoVelocidad", c.incrementoVelocidad);
+    f("fotogramasCambioColor", c.fotogramasCambioColor);
+    f("tamanoCelda", c.tamanoCelda); f("tasaEspontanea", c.tasaEspontanea);
+    f("radioJugador", c.radioJugador); f("radioItem", c.radioItem); f("capacidadItems", c.capacidadItems);
+    f("fotogramasMostrarTitulo", c.fotogramasMostrarTitulo); f("fotogramasMostrarNivel", c.fotogramasMostrarNivel);
+}
+
+// Valores admitidos en cada campo cuando vienen de fuera (opciones, barridos,
+// grabaciones y capturas). Fuera de ellos la simulación divide por cero,
+// reserva memoria sin límite o no termina un paso. Los enteros, y el lado de
+// celda, que se usa como número entero de píxeles, no admiten decimales.
+struct RangoCampo {
+    const char* nombre;
+    double      minimo, maximo;
+    bool        entero;
+};
+static const RangoCampo rangosConfiguracion[] = {
+    {"gravedad",                -1e5, 1e5,     false},
+    {"friccionSuelo",           0,    1,       false},
+    {"friccionAire",            0,    1,       false},
+    {"velocidadMovimiento",     0,    1e5,     false},
+    {"velocidadSalto",          0,    1e5,     false},
+    {"velocidadDesplazamiento", 0,    1e5,     false},
+    {"incrementoVelocidad",     0,    1e4,     false},
+    {"fotogramasCambioColor",   1,    1e9,     true},
+    {"tamanoCelda",             1,    4096,    true},
+    {"tasaEspontanea",          0,    1,       false},
+    {"radioJugador",            1,    1000,    false},
+    {"radioItem",               1,    1000,    false},
+    {"capacidadItems",          0,    1 << 22, true},
+    {"fotogramasMostrarTitulo", 0,    1e9,     true},
+    {"fotogramasMostrarNivel",  0,    1e9,     true},
+};
+
+static bool valorCampoValido(const string& nombre, double v) {
+    for (const RangoCampo& r : rangosConfiguracion)
+        if (nombre == r.nombre)
+            return isfinite(v) && v >= r.minimo && v <= r.maximo && (!r.entero || v == floor(v));
+    return false;
+}
+
+static bool configuracionValida(const ConfiguracionJuego& c) {
+    bool valida = true;
+    camposConfiguracion(c, [&](const char* n, auto v) { valida = valida && valorCampoValido(n, (double)v); });
+    return valida;
+}
+
+// Medidas del mundo en píxeles que llegan de una grabación o una captura
+static bool medidasValidas(int ancho, int alto) {
+    return ancho >= 1 && ancho <= 1 << 16 && alto >= 1 && alto <= 1 << 16;
+}
+
+// Paleta de colores
+static const vector<string> coloresHex = {
+    "#0000FF", "#8A2BE2", "#A52A2A", "#5F9EA0", "#D2691E", "#FF7F50", "#6495ED", "#DC143C",
+    "#00CED1", "#00008B", "#008B8B", "#B8860B", "#006400", "#8B008B", "#556B2F", "#FF8C00",
+    "#9932CC", "#8B0000", "#483D8B", "#2F4F4F", "#00CED1", "#9400D3", "#FF1493", "#00BFFF",
+    "#696969", "#1E90FF", "#B22222", "#228B22", "#FF00FF", "#808080", "#008000", "#FF69B4",
+    "#CD5C5C", "#4B0082", "#F08080", "#20B2AA", "#778899", "#00FF00", "#32CD32", "#FF00FF",
+    "#800000", "#0000CD", "#BA55D3", "#9370DB", "#3CB371", "#7B68EE", "#C71585", "#191970",
+    "#000080", "#808000", "#6B8E23", "#FF4500", "#DA70D6", "#DB7093", "#CD853F", "#800080",
+    "#663399", "#FF0000", "#BC8F8F", "#4169E1", "#8B4513", "#FA8072", "#2E8B57", "#A0522D",
+    "#6A5ACD", "#708090", "#4682B4", "#008080", "#FF6347"
+};
+
 // Convertir cadena de color hex a Scalar de OpenCV (B, G, R)
 static Scalar hex2Scalar(const string& hex) {
     int r = stoi(hex.substr(1,2), nullptr, 16);
@@ -45,423 +141,4136 @@ static Scalar hex2Scalar(const string& hex) {
     return Scalar(b, g, r);
 }
 
-struct Celda {
-    Point2f centro;
-    bool viva, creciendo, encogiendo, zonaSinGeneracion;
-    double factorTamano;
-    int indiceColor, fotogramasPorActualizacion, cuentaAtrasFotogramas;
-};
+// La paleta ya convertida, en el orden de coloresHex: el dibujo indexa aquí
+// en vez de convertir la cadena de cada celda en cada fotograma
+static const vector<Scalar> paletaBGR = [] {
+    vector<Scalar> p;
+    for (const string& hex : coloresHex) p.push_back(hex2Scalar(hex));
+    return p;
+}();
+
+// ===== Capa de índices =====
+// La capa de celdas guarda un byte por píxel: el índice del color en
+// coloresHex, o indiceBlanco para el fondo. Como el blanco es 255 en los dos
+// formatos, rellenar con Scalar(255,255,255) sirve igual para una capa de
+// índices que para una BGR. Se pasa a BGR una sola vez por fotograma, al
+// componerlo, con una tabla de 32 bits por índice (B | G << 8 | R << 16).
+static constexpr uint8_t indiceBlanco = 255;
+
+static const vector<uint32_t> tablaPaleta = [] {
+    vector<uint32_t> t(256, 0xFFFFFF);
+    for (size_t i = 0; i < paletaBGR.size(); ++i)
+        t[i] = (uint32_t)paletaBGR[i][0] | (uint32_t)paletaBGR[i][1] << 8 | (uint32_t)paletaBGR[i][2] << 16;
+    return t;
+}();
+
+// Cuatro bytes por píxel avanzando tres, cuando el orden de bytes lo
+// permite: el cuarto lo pisa el píxel siguiente. El último va byte a byte.
+static void expandirIndicesEscalar(const uint8_t* origen, uint8_t* destino, int n, const uint32_t* tabla) {
+    int i = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 1 < n; ++i, destino += 3) {
+        const uint32_t v = tabla[origen[i]];
+        memcpy(destino, &v, 4);
+    }
+#endif
+    for (; i < n; ++i, destino += 3) {
+        const uint32_t v = tabla[origen[i]];
+        destino[0] = (uint8_t)v;
+        destino[1] = (uint8_t)(v >> 8);
+        destino[2] = (uint8_t)(v >> 16);
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+// Ocho píxeles por vuelta: los índices se amplían a 32 bits, una recogida
+// trae las ocho entradas de la tabla y un barajado quita el cuarto byte en
+// cada mitad de 128 bits, que queda con 12 bytes seguidos. Las dos mitades
+// se guardan con 16 bytes cada una, solapadas; lo que sobra al final lo pisa
+// la vuelta siguiente, así que las vueltas dejan al menos dos píxeles para
+// el final escalar.
+__attribute__((target("avx2")))
+static void expandirIndicesAVX2(const uint8_t* origen, uint8_t* destino, int n, const uint32_t* tabla) {
+    const __m256i quitarX = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int i = 0;
+    for (; i + 10 <= n; i += 8, destino += 24) {
+        const __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(origen + i)));
+        const __m256i bgrx    = _mm256_i32gather_epi32((const int*)tabla, indices, 4);
+        const __m256i bgr     = _mm256_shuffle_epi8(bgrx, quitarX);
+        _mm_storeu_si128((__m128i*)destino, _mm256_castsi256_si128(bgr));
+        _mm_storeu_si128((__m128i*)(destino + 12), _mm256_extracti128_si256(bgr, 1));
+    }
+    expandirIndicesEscalar(origen + i, destino, n - i, tabla);
+}
+#endif
 
+// n índices de origen a 3n bytes BGR en destino. Con GCC en x86-64 se usa
+// la versión AVX2 si el procesador la tiene.
+static void expandirIndices(const uint8_t* origen, uint8_t* destino, int n) {
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        expandirIndicesAVX2(origen, destino, n, tablaPaleta.data());
+        return;
+    }
+#endif
+    expandirIndicesEscalar(origen, destino, n, tablaPaleta.data());
+}
+
+// ======== Núcleo del autómata ========
+// El estado vivo/muerto se guarda en planos de bits por columna: la palabra i
+// de una columna lleva las filas 64*i .. 64*i+63. Las columnas van seguidas,
+// así que el vecino izquierdo/derecho de una palabra está a una columna de
+// distancia en el mismo plano y el núcleo puede recorrerlo por bloques.
+#if defined(__GNUC__)
+typedef uint64_t BloqueBits __attribute__((vector_size(32), aligned(8), may_alias));
+#else
+typedef uint64_t BloqueBits;
+#endif
+static constexpr int palabrasBloque = sizeof(BloqueBits) / sizeof(uint64_t);
+
+// Con GCC en x86-64 se compila una versión AVX2 y otra SSE2 del núcleo y se
+// elige al cargar el programa; en otros compiladores los bloques son escalares.
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define VIDA_MULTIVERSION __attribute__((target_clones("avx2", "default")))
+#else
+#define VIDA_MULTIVERSION
+#endif
+
+static inline int bitMasBajo(uint64_t w) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(w);
+#else
+    int n = 0;
+    while (!(w & 1)) { w >>= 1; ++n; }
+    return n;
+#endif
+}
+
+static inline int contarBits(uint64_t w) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(w);
+#else
+    int n = 0;
+    for (; w; w &= w - 1) ++n;
+    return n;
+#endif
+}
+
+// Regla B3/S23 con sumadores por bits: cada bit es una celda y sus ocho
+// vecinos (a..j, sin v) se suman en paralelo. Sólo hace falta saber si la
+// cuenta es 2 o 3: unos/doses son los bits de peso 1 y 2 de la suma, y k1|k2
+// indica que llega a 4 o más. Todo por referencia: los bloques AVX no pueden
+// pasarse por valor entre funciones compiladas para distintas extensiones.
+template <class T>
+#if defined(__GNUC__)
+__attribute__((always_inline))
+#endif
+static inline void reglaVida(T& siguiente,
+                             const T& a, const T& b, const T& d, const T& e, const T& v,
+                             const T& f, const T& g, const T& h, const T& j) {
+    T xab   = a ^ b;
+    T s1    = xab ^ d,   c1 = (a & b) | (d & xab);
+    T xeg   = e ^ f;
+    T s2    = xeg ^ g,   c2 = (e & f) | (g & xeg);
+    T s3    = h ^ j,     c3 = h & j;
+    T x12   = s1 ^ s2;
+    T unos  = x12 ^ s3,  c4 = (s1 & s2) | (s3 & x12);
+    T x123  = c1 ^ c2;
+    T t     = x123 ^ c3, k1 = (c1 & c2) | (c3 & x123);
+    T doses = t ^ c4,    k2 = t & c4;
+    siguiente = doses & ~(k1 | k2) & (unos | v);
+}
+
+// Columnas primera..ultima-1 desplazadas una fila, con el toro vertical: en
+// norte el bit y es la fila y-1 y en sur la fila y+1.
+static void desplazarColumnas(const uint64_t* vivas, uint64_t* norte, uint64_t* sur,
+                              int primera, int ultimaColumna, int palabras, int filas) {
+    const int      ultima        = (filas - 1) >> 6;
+    const uint64_t bitUltima     = 1ull << ((filas - 1) & 63);
+    const uint64_t mascaraUltima = bitUltima | (bitUltima - 1);
+    for (int p = primera; p < ultimaColumna; ++p) {
+        const uint64_t* c = vivas + (size_t)p * palabras;
+        uint64_t*       n = norte + (size_t)p * palabras;
+        uint64_t*       s = sur   + (size_t)p * palabras;
+        for (int i = 0; i <= ultima; ++i) {
+            n[i] = (c[i] << 1) | (i > 0      ? c[i-1] >> 63 : 0);
+            s[i] = (c[i] >> 1) | (i < ultima ? c[i+1] << 63 : 0);
+        }
+        n[ultima] &= mascaraUltima;
+        if (c[ultima] & bitUltima) n[0]      |= 1;
+        if (c[0] & 1)              s[ultima] |= bitUltima;
+    }
+}
+
+// Siguiente generación de las columnas primera..ultima-1 de la rejilla (toro);
+// norte y sur deben estar al día en ellas y en sus vecinas. Las columnas
+// interiores se recorren como un único vector de palabras; la primera y la
+// última de la rejilla, que tienen el vecino al otro lado del toro, palabra
+// a palabra.
+VIDA_MULTIVERSION
+static void siguienteGeneracion(const uint64_t* vivas, const uint64_t* norte,
+                                const uint64_t* sur, uint64_t* siguiente,
+                                int columnas, int palabras, int primera, int ultima) {
+    const size_t P = palabras;
+    auto palabra = [&](size_t k, size_t l, size_t r) {
+        reglaVida(siguiente[k], norte[l], vivas[l], sur[l], norte[k], vivas[k],
+                  sur[k], norte[r], vivas[r], sur[r]);
+    };
+    auto columnaBorde = [&](int c) {
+        const size_t l = (size_t)((c + columnas - 1) % columnas) * P;
+        const size_t r = (size_t)((c + 1) % columnas) * P;
+        for (size_t w = 0; w < P; ++w) palabra(c * P + w, l + w, r + w);
+    };
+    if (primera >= ultima) return;
+    if (primera == 0) columnaBorde(primera++);
+    if (ultima == columnas && ultima > primera) columnaBorde(--ultima);
+    size_t       k   = (size_t)primera * P;
+    const size_t fin = (size_t)ultima * P;
+    for (; k + palabrasBloque <= fin; k += palabrasBloque) {
+        // copias locales: al deducir T se pierde la alineación de 8 de
+        // BloqueBits y las referencias a memoria sin alinear fallarían
+        BloqueBits a = *(const BloqueBits*)(norte + k - P);
+        BloqueBits b = *(const BloqueBits*)(vivas + k - P);
+        BloqueBits d = *(const BloqueBits*)(sur   + k - P);
+        BloqueBits e = *(const BloqueBits*)(norte + k);
+        BloqueBits v = *(const BloqueBits*)(vivas + k);
+        BloqueBits f = *(const BloqueBits*)(sur   + k);
+        BloqueBits g = *(const BloqueBits*)(norte + k + P);
+        BloqueBits h = *(const BloqueBits*)(vivas + k + P);
+        BloqueBits j = *(const BloqueBits*)(sur   + k + P);
+        BloqueBits sig;
+        reglaVida(sig, a, b, d, e, v, f, g, h, j);
+        *(BloqueBits*)(siguiente + k) = sig;
+    }
+    for (; k < fin; ++k) palabra(k, k - P, k + P);
+}
+
+// Llama a f(a, b) por cada tramo a..b-1 de posiciones seguidas con marca
+// entre desde y hasta-1
+template <class F>
+static void recorrerTramos(const vector<uint8_t>& marcas, int desde, int hasta, F f) {
+    for (int a = desde; a < hasta;) {
+        if (!marcas[a]) { ++a; continue; }
+        int b = a + 1;
+        while (b < hasta && marcas[b]) ++b;
+        f(a, b);
+        a = b;
+    }
+}
+
+// posAnterior es la posición al empezar el último paso; el dibujo en otro
+// hilo interpola entre ella y pos
 struct Recuperable {
-    Point2f pos, vel;
-    bool recolectado;
+    Point2f pos, vel, posAnterior;
     float radio;
 };
 
 struct Jugador {
-    Point2f pos, vel;
+    Point2f pos, vel, posAnterior;
     float radio;
     bool enSuelo, mirandoDerecha;
 };
 
-int main() {
-    // Ventana y temporización
-    int ancho  = 1920;
-    int alto   = 1080;
-    const int fps    = 60;
-    const double dt  = 1.0 / fps;
+// Estado de las teclas en un fotograma (teclado o entrada guionada)
+struct Entrada {
+    bool izquierda = false;
+    bool derecha   = false;
+    bool salto     = false;
 
-    ConfiguracionJuego cfg;
+    // Empaquetada en bits para pasarla entre hilos
+    uint8_t bits() const { return (izquierda ? 1 : 0) | (derecha ? 2 : 0) | (salto ? 4 : 0); }
+    static Entrada desdeBits(uint8_t b) {
+        Entrada e;
+        e.izquierda = b & 1;
+        e.derecha   = b & 2;
+        e.salto     = b & 4;
+        return e;
+    }
+};
 
-    const double tamanoCelda = 120.0;
-    int columnas = ancho  / (int)tamanoCelda;
-    int filas    = alto   / (int)tamanoCelda;
+// ======== Reserva de hilos ========
+// Hilos persistentes para repartir trabajo por teselas o bandas. paraCada(n, f)
+// llama a f(0) .. f(n-1) repartiendo los índices entre los hilos y el
+// llamante, que también trabaja, y vuelve cuando han terminado todos.
+struct ReservaHilos {
+    explicit ReservaHilos(int hilos);   // 0 = uno por núcleo
+    ~ReservaHilos();
 
-    // Configuración de SDL
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-        cerr << "Error SDL_Init: " << SDL_GetError() << endl;
-        return 1;
+    int  numHilos() const { return (int)trabajadores.size() + 1; }
+    void paraCada(int n, const function<void(int)>& f);
+
+private:
+    vector<thread>             trabajadores;
+    mutex                      m;
+    condition_variable         hayTrabajo, terminado;
+    const function<void(int)>* tarea     = nullptr;
+    int                        total     = 0;
+    atomic<int>                siguiente{0};
+    int                        activos   = 0;   // trabajadores que no han acabado la ronda
+    unsigned                   ronda     = 0;
+    bool                       salir     = false;
+
+    void bucle();
+    void trabajar() {
+        for (int i; (i = siguiente.fetch_add(1)) < total;) (*tarea)(i);
     }
-    SDL_Window*   ventana   = SDL_CreateWindow("Plataformas",
-                                              SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                              ancho, alto,
-                                              SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
-    SDL_Renderer* renderizador = SDL_CreateRenderer(ventana, -1, SDL_RENDERER_ACCELERATED);
-    SDL_Texture*  textura  = SDL_CreateTexture(renderizador,
-                                              SDL_PIXELFORMAT_BGR24,
-                                              SDL_TEXTUREACCESS_STREAMING,
-                                              ancho, alto);
+};
+
+ReservaHilos::ReservaHilos(int hilos) {
+    if (hilos <= 0) hilos = (int)max(1u, thread::hardware_concurrency());
+    for (int i = 1; i < hilos; ++i) trabajadores.emplace_back([this] { bucle(); });
+}
+
+ReservaHilos::~ReservaHilos() {
+    {
+        lock_guard<mutex> l(m);
+        salir = true;
+    }
+    hayTrabajo.notify_all();
+    for (auto& t : trabajadores) t.join();
+}
+
+void ReservaHilos::paraCada(int n, const function<void(int)>& f) {
+    if (trabajadores.empty() || n <= 1) {
+        for (int i = 0; i < n; ++i) f(i);
+        return;
+    }
+    {
+        lock_guard<mutex> l(m);
+        tarea     = &f;
+        total     = n;
+        siguiente = 0;
+        activos   = (int)trabajadores.size();
+        ronda++;
+    }
+    hayTrabajo.notify_all();
+    trabajar();
+    // Cada trabajador pasa por todas las rondas: no se lanza la siguiente
+    // hasta que todos han terminado ésta.
+    unique_lock<mutex> l(m);
+    terminado.wait(l, [this] { return activos == 0; });
+    tarea = nullptr;
+}
+
+void ReservaHilos::bucle() {
+    unsigned vista = 0;
+    unique_lock<mutex> l(m);
+    for (;;) {
+        hayTrabajo.wait(l, [&] { return salir || ronda != vista; });
+        if (salir) return;
+        vista = ronda;
+        l.unlock();
+        trabajar();
+        l.lock();
+        if (--activos == 0) terminado.notify_one();
+    }
+}
+
+// ======== Medición de fases ========
+// Las primeras corren en el hilo de simulación (o en el único hilo sin
+// ventana); desde FASE_ENTRADA, en el de presentación.
+enum Fase {
+    FASE_FISICA,      // entrada, gravedad y desplazamiento del mundo
+    FASE_RECICLAR,    // reciclado de columnas y generación de ítems
+    FASE_CELDAS,      // animación y reglas de vida
+    FASE_ITEMS,       // física y recolección de ítems
+    FASE_JUGADOR,     // colisión del jugador y salto
+    FASE_DIBUJO,      // rasterización del fotograma (con ventana, sólo la capa de celdas)
+    FASE_ENTRADA,     // eventos y teclado
+    FASE_COMPONER,    // fondo, ítems y jugador sobre el fotograma
+    FASE_ROTULOS,     // textos superpuestos
+    FASE_SUBIDA,      // SDL_UpdateTexture o bloqueo de la textura
+    FASE_PRESENTAR,   // SDL_RenderCopy y SDL_RenderPresent
+    NUM_FASES,
+    NUM_FASES_MUNDO = FASE_ENTRADA
+};
+
+static const char* nombresFase[NUM_FASES] = {
+    "fisica", "reciclar", "celdas", "items", "jugador", "dibujo",
+    "entrada", "componer", "rotulos", "subida", "presentar"
+};
+
+using Reloj = chrono::steady_clock;
+
+// Superposiciones de texto de un fotograma
+struct Rotulos {
+    int    ancho = 0, alto = 0;      // del fotograma, en píxeles
+    double escala = 1;               // del dibujo (Mundo::escalaDibujo)
+    int  nivel = 1, puntuacion = 0;
+    bool nivelVisible = false, tituloVisible = false;
+};
+
+struct LectorCaptura;
+
+// ======== Mundo ========
+// Todo el estado de una partida. No depende de SDL: se puede avanzar
+// sin ventana (modo sin ventana y benchmark) o desde el bucle interactivo.
+struct Mundo {
+    static constexpr int    fps = 60;
+    static constexpr double dt  = 1.0 / fps;
+
+    ConfiguracionJuego cfg;
+    int ancho, alto;
+    int columnas, filas;
 
     // Generador de números aleatorios
-    mt19937 rng((unsigned)time(nullptr));
-    uniform_real_distribution<double> dist01(0,1);
-    uniform_real_distribution<double> distVelocidad(0.5,2.0);
+    mt19937 rng;
+    uniform_real_distribution<double> dist01{0,1};
+    uniform_real_distribution<double> distVelocidad{0.5,2.0};
 
-    // Paleta de colores
-    std::vector<std::string> coloresHex = {
-    "#0000FF", "#8A2BE2", "#A52A2A", "#5F9EA0", "#D2691E", "#FF7F50", "#6495ED", "#DC143C",
-    "#00CED1", "#00008B", "#008B8B", "#B8860B", "#006400", "#8B008B", "#556B2F", "#FF8C00",
-    "#9932CC", "#8B0000", "#483D8B", "#2F4F4F", "#00CED1", "#9400D3", "#FF1493", "#00BFFF",
-    "#696969", "#1E90FF", "#B22222", "#228B22", "#FF00FF", "#808080", "#008000", "#FF69B4",
-    "#CD5C5C", "#4B0082", "#F08080", "#20B2AA", "#778899", "#00FF00", "#32CD32", "#FF00FF",
-    "#800000", "#0000CD", "#BA55D3", "#9370DB", "#3CB371", "#7B68EE", "#C71585", "#191970",
-    "#000080", "#808000", "#6B8E23", "#FF4500", "#DA70D6", "#DB7093", "#CD853F", "#800080",
-    "#663399", "#FF0000", "#BC8F8F", "#4169E1", "#8B4513", "#FA8072", "#2E8B57", "#A0522D",
-    "#6A5ACD", "#708090", "#4682B4", "#008080", "#FF6347"
+    vector<int>         paleta;
+    int                 indiceCicloColor = 0;
+
+    // Rejilla circular por columnas: la columna lógica x (0 = la de más a la
+    // izquierda) ocupa la columna física (columnaInicial + x) % columnas, y
+    // sus filas son contiguas. Reciclar una columna sólo reescribe sus filas
+    // y avanza columnaInicial, sin mover ni reservar memoria. La posición de
+    // una celda no se guarda: se deduce de su columna y fila (centroCelda).
+    int                 columnaInicial = 0;
+    double              origenX        = 0;   // borde izquierdo de la columna lógica 0
+    long                columnasRecicladas = 0;
+    unsigned            generacionRejilla  = 0;  // cambia en cada reiniciar()
+
+    // Estado de las celdas en planos separados. Los de bits tienen
+    // palabrasColumna palabras por columna física; los de bytes, filasPlano
+    // = 64 * palabrasColumna bytes, de modo que el índice físico i de una
+    // celda da directamente su palabra (i >> 6) y su bit (i & 63).
+    static constexpr int pasosTamano = 20;    // el tamaño crece o mengua 1/20 por fotograma
+    int                 palabrasColumna = 0;
+    int                 filasPlano      = 0;
+    vector<uint64_t>    vivas;                // 1 = célula viva
+    vector<uint64_t>    zonaSinGeneracion;    // 1 = zona central, sin reglas de vida
+    vector<uint8_t>     pasoTamano;           // tamaño dibujado = pasoTamano / pasosTamano
+    vector<uint8_t>     fotogramaDebido;      // fotograma (módulo 256) de la próxima actualización
+    vector<uint8_t>     periodo;              // fotogramas entre actualizaciones
+    vector<uint8_t>     indiceColor;
+    vector<uint8_t>     enAnimacion;          // 1 = está en la lista animando
+    vector<uint64_t>    cambiadas;            // 1 = hay que volver a dibujar la celda
+
+    // Planificador: en vez de descontar una cuenta atrás en todas las celdas,
+    // la ranura f % tamanoRueda de la rueda guarda las celdas (índice físico)
+    // que aplican la regla en el fotograma f, y animando las que crecen o
+    // encogen. Cada fotograma sólo toca esas celdas. Al reciclar una columna
+    // sus entradas quedan obsoletas y se descartan comparando fotogramaDebido.
+    //
+    // Hay una rueda por tesela: una palabra de columna (64 filas) en un grupo
+    // de columnasTesela columnas físicas seguidas. Una tesela sólo escribe sus
+    // propias palabras de bits y sus bytes, así que las teselas se actualizan
+    // en paralelo sin carreras, y hay muchas más que hilos aunque la rejilla
+    // tenga pocas filas. Cada una sortea los nacimientos espontáneos con su
+    // propio generador; como el reparto sólo depende del tamaño de la
+    // rejilla y no de cuántos hilos haya, el resultado tampoco.
+    static constexpr int tamanoRueda    = 128;   // mayor que el periodo máximo (120)
+    static constexpr int columnasTesela = 4;
+    struct Tesela {
+        vector<uint32_t>             rueda[tamanoRueda];
+        vector<uint32_t>             animando;
+        mt19937                      rng;
+        geometric_distribution<long> distEspontanea;
+        long                         saltoEspontaneo = 0;  // candidatas a saltar hasta el próximo nacimiento
+        long                         celdasTocadas   = 0;
+        long                         reglasEvaluadas = 0;
     };
+    vector<Tesela>      teselas;              // por grupo de columnas, sus palabrasColumna teselas
 
-    bool salirTodo = false;
-    while (!salirTodo) {
-        // Mezclar los índices de la paleta
-        int totalColores = (int)coloresHex.size();
-        vector<int> paleta(totalColores);
-        iota(paleta.begin(), paleta.end(), 0);
-        shuffle(paleta.begin(), paleta.end(), rng);
-        int indiceCicloColor = 0;
-
-        // Inicializar celdas
-        vector<Celda> celdas;
-        celdas.reserve(columnas * filas);
-        for (int y = 0; y < filas; ++y) {
-            for (int x = 0; x < columnas; ++x) {
-                Celda c;
-                c.centro = Point2f(x * tamanoCelda + tamanoCelda/2,
-                                   y * tamanoCelda + tamanoCelda/2);
-                bool zonaCentral = fabs(c.centro.x - ancho/2) < tamanoCelda
-                               && fabs(c.centro.y - alto/2) < tamanoCelda;
-                c.zonaSinGeneracion = zonaCentral;
-                c.viva       = !zonaCentral && dist01(rng) > 0.5;
-                c.factorTamano  = c.viva ? 1.0 : 0.0;
-                c.creciendo     = c.viva;
-                c.encogiendo   = false;
-                c.indiceColor    = paleta[indiceCicloColor];
-                double velocidad  = distVelocidad(rng);
-                c.fotogramasPorActualizacion = max(1, (int)round(fps / velocidad));
-                c.cuentaAtrasFotogramas  = c.fotogramasPorActualizacion;
-                celdas.push_back(c);
-            }
+    // Planos auxiliares del paso de vida, reservados en reiniciar()
+    vector<uint64_t>    norte, sur, siguientes;
+    // por columna física: tiene celdas debidas este fotograma / hay que
+    // desplazarla porque ella o una vecina las tiene
+    vector<uint8_t>     columnaDebida, columnaDesplazar;
+
+    // Ítems vivos, sin huecos: los recogidos o fuera de pantalla se liberan
+    // moviendo el último a su sitio. La capacidad se reserva una vez.
+    vector<Recuperable> items;
+    vector<uint8_t>     liberarItem;          // por ítem: 0 sigue, 1 fuera de pantalla, 2 recogido
+    size_t              picoItems        = 0;
+    long                itemsLiberados   = 0;
+    long                itemsDescartados = 0;   // no generados por estar llena la reserva
+    Jugador             jugador;
+
+    int    cuentaGlobalFotogramas  = 0;
+    int    nivel                   = 1;
+    int    cuentaMostrarNivel      = 0;
+    bool   mostrarTitulo           = true;
+    int    cuentaMostrarTitulo     = 0;
+    bool   mostrandoNivel          = false;   // superposiciones a dibujar este fotograma
+    bool   mostrandoTitulo         = false;
+    int    puntuacion              = 0;
+    double velocidadDesplazamiento = 0;
+
+    // Tiempos acumulados por fase (ns); sólo se miden si medirFases está activo
+    bool   medirFases = false;
+    double nsFase[NUM_FASES] = {};
+    long   celdasTocadas = 0;     // celdas animadas o evaluadas, acumulado
+    long   reglasEvaluadas = 0;   // celdas a las que se aplicó la regla, acumulado
+    long   columnasNucleo = 0;    // columnas recorridas por el núcleo de vida, acumulado
+
+    // Sin reserva todo corre en el hilo llamante
+    ReservaHilos* hilos = nullptr;
+
+    // Sin fase amplia las colisiones recorren toda la rejilla; el resultado
+    // es el mismo y sólo sirve para compararlas en el benchmark
+    bool faseAmplia = true;
+
+    int celdaDibujo;   // lado de una celda en píxeles al dibujar, de 1 a tamanoCelda
+
+    Mundo(const ConfiguracionJuego& c, int anchoInicial, int altoInicial, unsigned semilla)
+        : cfg(c), ancho(anchoInicial), alto(altoInicial), rng(semilla),
+          celdaDibujo((int)c.tamanoCelda) {
+        reiniciar();
+    }
+
+    void reiniciar();
+    void redimensionar(int nuevoAncho, int nuevoAlto);   // sin reiniciar la partida
+    bool paso(const Entrada& entrada);   // devuelve false si el jugador pierde
+    void dibujar(Mat& fotograma) const;  // dibujo completo, sin estado
+    long dibujarCeldas(Mat& capa) const;   // devuelven los píxeles de celdas escritos
+    int  dibujarCelda(Mat& capa, int x, int y, bool limpiar, int origen = 0) const;
+    void dibujarDinamico(Mat& fotograma) const;
+    void dibujarItemsJugador(Mat& banda, int y0) const;   // banda = filas y0.. del fotograma
+    void dibujarTextos(Mat& fotograma) const;
+    Rotulos rotulos() const;
+    uint64_t huella() const;   // resumen del estado para comparar ejecuciones
+    void capturar(vector<char>& bytes) const;   // ver Capturas del mundo
+    bool restaurar(const char* datos, size_t n);
+    long celdasVivas() const;
+
+    // f(0) .. f(n-1), repartidos entre los hilos si hay reserva
+    template <class F>
+    void enParalelo(int n, F f) const {
+        if (hilos && n > 1) hilos->paraCada(n, f);
+        else for (int i = 0; i < n; ++i) f(i);
+    }
+    int  numHilos() const { return hilos ? hilos->numHilos() : 1; }
+
+    // Acceso a la rejilla por coordenadas lógicas
+    int columnaFisica(int x) const {
+        int fisica = columnaInicial + x;
+        return fisica >= columnas ? fisica - columnas : fisica;
+    }
+    int indiceCelda(int x, int y) const { return columnaFisica(x) * filasPlano + y; }
+    bool viva(int x, int y) const    { return leerBit(vivas, x, y); }
+    bool enZona(int x, int y) const  { return leerBit(zonaSinGeneracion, x, y); }
+    double factorTamano(int x, int y) const {
+        return pasoTamano[indiceCelda(x, y)] / (double)pasosTamano;
+    }
+    Point2f centroCelda(int x, int y) const {
+        return Point2f((float)(origenX + (x + 0.5) * cfg.tamanoCelda),
+                       (float)((y + 0.5) * cfg.tamanoCelda));
+    }
+
+    // Geometría en píxeles para dibujar. El origen se redondea una sola vez,
+    // de modo que todas las celdas se mueven la misma cantidad entera y lo ya
+    // dibujado puede desplazarse en vez de repetirse (ver DibujoIncremental).
+    // Con celdaDibujo menor que tamanoCelda se dibuja a una resolución
+    // interna reducida en la misma proporción; la simulación no cambia.
+    // A escala completa no se multiplica nada y el dibujo es el de siempre.
+    bool  escalaCompleta() const { return celdaDibujo == (int)cfg.tamanoCelda; }
+    float escalaDibujo() const { return (float)celdaDibujo / (int)cfg.tamanoCelda; }
+    int   anchoDibujo() const  { return escalaCompleta() ? ancho : (ancho * celdaDibujo + (int)cfg.tamanoCelda - 1) / (int)cfg.tamanoCelda; }
+    int   altoDibujo() const   { return escalaCompleta() ? alto  : (alto  * celdaDibujo + (int)cfg.tamanoCelda - 1) / (int)cfg.tamanoCelda; }
+    int   origenPixel() const  {
+        return (int)lround(escalaCompleta() ? origenX : origenX * celdaDibujo / (int)cfg.tamanoCelda);
+    }
+    long  desplazamientoPixeles() const {
+        return columnasRecicladas * (long)celdaDibujo - origenPixel();
+    }
+    Rect cuadroCelda(int x, int y) const {
+        const int t = celdaDibujo;
+        return Rect(origenPixel() + x * t, y * t, t, t);
+    }
+    Rect rectCelda(int x, int y) const {
+        const Rect c = cuadroCelda(x, y);
+        const int  s = (int)lround(c.width * (double)pasoTamano[indiceCelda(x, y)] / pasosTamano);
+        const int  m = (c.width - s) / 2;
+        return Rect(c.x + m, c.y + m, s, s);
+    }
+
+private:
+    // Fase amplia de colisiones: recorre, en el mismo orden que un barrido
+    // completo (por columnas y dentro de cada una por filas), sólo las celdas
+    // cuyo cuadro de la retícula puede solapar caja(). La caja se vuelve a
+    // pedir tras cada celda porque las colisiones mueven al objeto; así se
+    // visitan las mismas celdas con efecto que en el barrido completo.
+    // El margen de una celda cubre el redondeo de las posiciones en float.
+    template <class Caja, class Visitar>
+    void recorrerCeldasCercanas(Caja caja, Visitar visitar) const {
+        const double tc = cfg.tamanoCelda;
+        auto indice = [](double v, int maximo) {
+            return (int)max(-1.0, min((double)maximo, floor(v)));
+        };
+        auto primeraX = [&](const Rect2f& r) { return max(0, indice((r.x - origenX) / tc, columnas) - 1); };
+        auto ultimaX  = [&](const Rect2f& r) { return min(columnas - 1, indice((r.x + r.width - origenX) / tc, columnas) + 1); };
+        auto primeraY = [&](const Rect2f& r) { return max(0, indice(r.y / tc, filas) - 1); };
+        auto ultimaY  = [&](const Rect2f& r) { return min(filas - 1, indice((r.y + r.height) / tc, filas) + 1); };
+        if (!faseAmplia) {
+            for (int x = 0; x < columnas; ++x)
+                for (int y = 0; y < filas; ++y)
+                    visitar(x, y);
+            return;
         }
 
-        // Ítems recuperables
-        vector<Recuperable> items;
-
-        // Jugador
-        Jugador jugador;
-        jugador.pos        = Point2f(ancho/2, alto/2);
-        jugador.vel        = Point2f(0,0);
-        jugador.radio     = cfg.radioJugador;
-        jugador.enSuelo   = false;
-        jugador.mirandoDerecha= true;
-
-        Mat fotograma(alto, ancho, CV_8UC3);
-        int cuentaGlobalFotogramas    = 0;
-        int nivel               = 1;
-        int cuentaMostrarNivel   = cfg.fotogramasMostrarNivel;
-        bool mostrarTitulo          = true;
-        int cuentaMostrarTitulo   = cfg.fotogramasMostrarTitulo;
-        int puntuacion               = 0;
-        bool salir               = false;
-        double velocidadDesplazamiento      = cfg.velocidadDesplazamiento;
-
-        while (!salir) {
-            // ===== Evento e Entrada =====
-            SDL_Event evento;
-            while (SDL_PollEvent(&evento)) {
-                if (evento.type == SDL_QUIT) {
-                    salir    = true;
-                    salirTodo = true;
-                } else if (evento.type == SDL_WINDOWEVENT && evento.window.event == SDL_WINDOWEVENT_RESIZED) {
-                    // Manejar redimensionamiento de ventana
-                    ancho  = evento.window.data1;
-                    alto   = evento.window.data2;
-                    columnas = ancho  / (int)tamanoCelda;
-                    filas    = alto   / (int)tamanoCelda;
-                    SDL_DestroyTexture(textura);
-                    textura = SDL_CreateTexture(renderizador,
-                                                SDL_PIXELFORMAT_BGR24,
-                                                SDL_TEXTUREACCESS_STREAMING,
-                                                ancho, alto);
-                    fotograma = Mat(alto, ancho, CV_8UC3);
-                }
-            }
-            const Uint8* teclas = SDL_GetKeyboardState(NULL);
-            if (teclas[SDL_SCANCODE_ESCAPE]) {
-                salir    = true;
-                salirTodo = true;
-            }
-            bool izquierda  = teclas[SDL_SCANCODE_A] || teclas[SDL_SCANCODE_LEFT];
-            bool derecha = teclas[SDL_SCANCODE_D] || teclas[SDL_SCANCODE_RIGHT];
-            bool salto  = teclas[SDL_SCANCODE_W] || teclas[SDL_SCANCODE_UP];
-
-            // Movimiento horizontal y dirección
-            if (izquierda) {
-                jugador.vel.x      = -cfg.velocidadMovimiento;
-                jugador.mirandoDerecha = false;
-            }
-            else if (derecha) {
-                jugador.vel.x      = +cfg.velocidadMovimiento;
-                jugador.mirandoDerecha = true;
-            }
+        for (int x = primeraX(caja()); x <= ultimaX(caja()); ++x)
+            for (int y = primeraY(caja()); y <= ultimaY(caja()); ++y)
+                visitar(x, y);
+    }
 
-            // Aplicar gravedad
-            jugador.vel.y += cfg.gravedad * dt;
-
-            // Fricción
-            if (jugador.enSuelo) jugador.vel.x *= cfg.friccionSuelo;
-            else                jugador.vel.x *= cfg.friccionAire;
-
-            // Desplazar mundo
-            for (auto& c : celdas)   c.centro.x -= velocidadDesplazamiento * dt;
-            for (auto& itm : items) itm.pos.x    -= velocidadDesplazamiento * dt;
-            jugador.pos.x            -= velocidadDesplazamiento * dt;
-
-            // Aplicar velocidad
-            jugador.pos += jugador.vel * dt;
-
-            // ===== Reciclar celdas y generar ítems =====
-            vector<Celda> nuevasCeldas;
-            for (auto it = celdas.begin(); it != celdas.end();) {
-                if (it->centro.x + tamanoCelda/2 < 0) {
-                    int yIdx = (int)(it->centro.y / tamanoCelda);
-                    // Nueva celda a la derecha
-                    Celda c;
-                    c.centro = Point2f(ancho + tamanoCelda/2,
-                                       yIdx*tamanoCelda + tamanoCelda/2);
-                    c.zonaSinGeneracion     = false;
-                    c.viva           = dist01(rng) > 0.5;
-                    c.factorTamano      = c.viva ? 1.0 : 0.0;
-                    c.creciendo         = c.viva;
-                    c.encogiendo       = false;
-                    c.indiceColor        = paleta[indiceCicloColor];
-                    double velocidad      = distVelocidad(rng);
-                    c.fotogramasPorActualizacion = max(1, (int)round(fps / velocidad));
-                    c.cuentaAtrasFotogramas  = c.fotogramasPorActualizacion;
-                    nuevasCeldas.push_back(c);
-
-                    // Generar ítem recuperable
-                    Recuperable itm;
-                    itm.pos       = Point2f(ancho + tamanoCelda/2, yIdx*tamanoCelda);
-                    itm.vel       = Point2f(0,0);
-                    itm.recolectado = false;
-                    itm.radio    = cfg.radioItem;
-                    items.push_back(itm);
-
-                    it = celdas.erase(it);
-                } else {
-                    ++it;
-                }
-            }
-            celdas.insert(celdas.end(), nuevasCeldas.begin(), nuevasCeldas.end());
-
-            // ===== Ciclo de nivel y color =====
-            if (cuentaGlobalFotogramas > 0
-             && cuentaGlobalFotogramas % cfg.fotogramasCambioColor == 0) {
-                indiceCicloColor = (indiceCicloColor + 1) % totalColores;
-                nivel++;
-                velocidadDesplazamiento += cfg.incrementoVelocidad;
-                cuentaMostrarNivel = cfg.fotogramasMostrarNivel;
-            }
-            int colorActual = paleta[indiceCicloColor];
-
-            // ===== Dibujar fondo =====
-            fotograma.setTo(Scalar(255,255,255));
-
-            // ===== Actualizar y dibujar celdas =====
-            for (size_t i = 0; i < celdas.size(); ++i) {
-                Celda &c = celdas[i];
-                // animación de tamaño
-                if (c.creciendo) {
-                    c.factorTamano = min(1.0, c.factorTamano + 0.05);
-                    if (c.factorTamano >= 1.0) c.creciendo = false;
-                } else if (c.encogiendo) {
-                    c.factorTamano = max(0.0, c.factorTamano - 0.05);
-                    if (c.factorTamano <= 0.0) c.encogiendo = false;
-                }
-                // reglas de vida
-                if (--c.cuentaAtrasFotogramas <= 0 && !c.zonaSinGeneracion) {
-                    int xIdx = i % columnas, yIdx = i / columnas, cnt = 0;
-                    for (int dy=-1; dy<=1; ++dy) for (int dx=-1; dx<=1; ++dx)
-                        if (dx||dy) {
-                            int nx = (xIdx+dx+columnas)%columnas;
-                            int ny = (yIdx+dy+filas)%filas;
-                            if (celdas[ny*columnas + nx].viva) cnt++;
-                        }
-                    bool siguienteViva = c.viva ? (cnt==2||cnt==3) : (cnt==3);
-                    if (siguienteViva && !c.viva) {
-                        c.viva     = true;
-                        c.factorTamano= 0;
-                        c.creciendo   = true;
-                        c.indiceColor  = colorActual;
-                    } else if (!siguienteViva && c.viva) {
-                        c.viva     = false;
-                        c.factorTamano= 1;
-                        c.encogiendo = true;
-                    } else if (!c.viva && dist01(rng) < cfg.tasaEspontanea) {
-                        c.viva     = true;
-                        c.factorTamano= 0;
-                        c.creciendo   = true;
-                        c.indiceColor  = colorActual;
-                    }
-                    c.cuentaAtrasFotogramas = c.fotogramasPorActualizacion;
-                }
-                // renderizar celdas vivas
-                if (c.factorTamano > 0) {
-                    Scalar col = hex2Scalar(coloresHex[c.indiceColor]);
-                    double s = tamanoCelda * c.factorTamano;
-                    Point2f tl(c.centro.x - s/2, c.centro.y - s/2);
-                    rectangle(fotograma,
-                              Rect2f(tl.x, tl.y, (float)s, (float)s),
-                              col, FILLED);
-                }
-            }
+    // Un mundo vacío en el que restaurar() decodifica antes de quedárselo
+    struct SinRejilla {};
+    explicit Mundo(SinRejilla) : ancho(0), alto(0), columnas(0), filas(0), celdaDibujo(1) {}
+    bool  decodificar(LectorCaptura& l);
 
-            // ===== Actualizar y dibujar ítems =====
-            for (auto &itm : items) {
-                if (itm.recolectado) continue;
-                itm.vel.y += cfg.gravedad * dt;
-                itm.pos   += itm.vel * dt;
-                // colisión con celdas
-                for (auto &c : celdas) {
-                    if (c.factorTamano <= 0 || c.zonaSinGeneracion) continue;
-                    double s = tamanoCelda * c.factorTamano;
-                    Rect2f br(c.centro.x - s/2, c.centro.y - s/2,
-                              (float)s, (float)s);
-                    Rect2f ir(itm.pos.x-itm.radio,
-                              itm.pos.y-itm.radio,
-                              itm.radio*2, itm.radio*2);
-                    if ((ir & br).area() > 0) {
-                        itm.pos.y = br.y - itm.radio;
-                        itm.vel.y = 0;
-                    }
-                }
-                circle(fotograma, itm.pos, (int)itm.radio,
-                       Scalar(0,215,255), FILLED);
-                // recolección
-                float dx = itm.pos.x - jugador.pos.x;
-                float dy = itm.pos.y - jugador.pos.y;
-                if (dx*dx + dy*dy < pow(itm.radio+jugador.radio,2)) {
-                    itm.recolectado = true;
-                    puntuacion += 10;
-                }
-            }
+    void  prepararRejilla();
+    void  inicializarCelda(int x, int y, bool zona);
+    void  actualizarCeldas(int colorActual);
+    void  actualizarTesela(Tesela& te, int colorActual);
+    void  moverItem(size_t k);
+    bool  nacimientoEspontaneo(Tesela& te);
+    Tesela& teselaCelda(uint32_t i) {
+        const uint32_t k = i >> 6;   // palabra: columna * palabrasColumna + palabra en la columna
+        return teselas[k / palabrasColumna / columnasTesela * palabrasColumna + k % palabrasColumna];
+    }
+    void  programar(Tesela& te, uint32_t i, uint32_t fotograma) {
+        fotogramaDebido[i] = (uint8_t)fotograma;
+        te.rueda[fotograma % tamanoRueda].push_back(i);
+    }
+    void  marcarCambiada(uint32_t i) { cambiadas[i >> 6] |= 1ull << (i & 63); }
+    void  animar(Tesela& te, uint32_t i) {
+        if (enAnimacion[i]) return;
+        enAnimacion[i] = 1;
+        te.animando.push_back(i);
+    }
+    bool  vivaFisica(uint32_t i) const { return (vivas[i >> 6] >> (i & 63)) & 1; }
+    bool  leerBit(const vector<uint64_t>& plano, int x, int y) const {
+        const int i = indiceCelda(x, y);
+        return (plano[i >> 6] >> (i & 63)) & 1;
+    }
+    void  escribirBit(vector<uint64_t>& plano, int x, int y, bool v) {
+        const int i   = indiceCelda(x, y);
+        uint64_t& w   = plano[i >> 6];
+        uint64_t  bit = 1ull << (i & 63);
+        w = v ? (w | bit) : (w & ~bit);
+    }
+    void  marcarFase(Fase f, Reloj::time_point& t0) {
+        if (!medirFases) return;
+        Reloj::time_point t1 = Reloj::now();
+        nsFase[f] += chrono::duration<double, nano>(t1 - t0).count();
+        t0 = t1;
+    }
+};
 
-            // ===== Colisión del jugador y verificación de suelo =====
-            jugador.enSuelo = false;
-            Rect2f pr(jugador.pos.x-jugador.radio,
-                      jugador.pos.y-jugador.radio,
-                      jugador.radio*2, jugador.radio*2);
-            for (auto &c : celdas) {
-                if (c.factorTamano<=0 || c.zonaSinGeneracion) continue;
-                double s = tamanoCelda*c.factorTamano;
-                Rect2f br(c.centro.x - s/2, c.centro.y - s/2,
-                          (float)s, (float)s);
-                Rect2f inter = pr & br;
-                if (inter.area()>0) {
-                    if (inter.width < inter.height) {
-                        jugador.pos.x += (pr.x+pr.width/2 < br.x+br.width/2)
-                                      ? -inter.width : inter.width;
-                        jugador.vel.x = 0;
-                    } else {
-                        jugador.pos.y += (pr.y+pr.height/2 < br.y+br.height/2)
-                                      ? -inter.height : inter.height;
-                        jugador.vel.y = 0;
-                        if (pr.y+pr.height/2 < br.y+br.height/2)
-                            jugador.enSuelo = true;
-                    }
-                    pr = Rect2f(jugador.pos.x-jugador.radio,
-                                jugador.pos.y-jugador.radio,
-                                jugador.radio*2, jugador.radio*2);
-                }
-            }
+void Mundo::inicializarCelda(int x, int y, bool zona) {
+    const int i = indiceCelda(x, y);
+    bool v = !zona && dist01(rng) > 0.5;
+    escribirBit(vivas, x, y, v);
+    escribirBit(zonaSinGeneracion, x, y, zona);
+    marcarCambiada(i);
+    pasoTamano[i]  = v ? pasosTamano : 0;
+    indiceColor[i] = (uint8_t)paleta[indiceCicloColor];
+    double velocidad = distVelocidad(rng);
+    periodo[i]     = (uint8_t)max(1, (int)round(fps / velocidad));
+    // la cuenta atrás empezaba en periodo y se descontaba antes de mirarla
+    if (!zona) programar(teselaCelda(i), i, cuentaGlobalFotogramas + periodo[i] - 1);
+}
 
-            // Salto
-            if (salto && jugador.enSuelo) {
-                jugador.vel.y = -cfg.velocidadSalto;
-                jugador.enSuelo = false;
-            }
+// En vez de sortear cada candidata a nacimiento espontáneo se sortea cuántas
+// saltar hasta la próxima (distribución geométrica): un sorteo por nacimiento.
+bool Mundo::nacimientoEspontaneo(Tesela& te) {
+    if (cfg.tasaEspontanea <= 0) return false;
+    if (te.saltoEspontaneo-- > 0) return false;
+    te.saltoEspontaneo = te.distEspontanea(te.rng);
+    return true;
+}
 
-            // Color del jugador y dibujo
-            Scalar colorJugador;
-            bool corriendo = fabs(jugador.vel.x)>0.1 && jugador.enSuelo;
-            if (!jugador.enSuelo)
-                colorJugador = jugador.mirandoDerecha
-                            ? Scalar(0,255,255)
-                            : Scalar(255,0,0);
-            else if (corriendo)
-                colorJugador = jugador.mirandoDerecha
-                            ? ((cuentaGlobalFotogramas%2==0)
-                                ? Scalar(0,255,0)
-                                : Scalar(255,0,255))
-                            : ((cuentaGlobalFotogramas%2==0)
-                                ? Scalar(0,0,255)
-                                : Scalar(255,255,0));
-            else
-                colorJugador = jugador.mirandoDerecha
-                            ? Scalar(0,255,0)
-                            : Scalar(0,0,255);
-
-            circle(fotograma, jugador.pos, (int)jugador.radio,
-                   colorJugador, FILLED);
-
-            // Condiciones de derrota
-            if (jugador.pos.x - jugador.radio <= 0
-             || jugador.pos.y + jugador.radio >= alto) {
-                salir = true; // reiniciar
+void Mundo::actualizarCeldas(int colorActual) {
+    const uint32_t fotograma = cuentaGlobalFotogramas;
+    const int      ranura    = fotograma % tamanoRueda;
+
+    // Reglas de vida con el núcleo por bits, que cuesta menos que contar los
+    // vecinos sólo de las celdas debidas, pero limitado a las columnas que
+    // tienen alguna: con celdas grandes son unas pocas; con celdas pequeñas
+    // casi todas, y el coste sigue al tamaño de la rejilla (la columna
+    // columnas_nucleo del benchmark lo muestra). Escribe en siguientes, así
+    // que las teselas leen vecinos de las demás sin carreras. Las columnas se
+    // reparten en trozos entre los hilos, primero para desplazarlas y después
+    // para la regla, que lee las vecinas ya desplazadas.
+    bool reglas = false;
+    fill(columnaDebida.begin(), columnaDebida.end(), 0);
+    for (const Tesela& te : teselas)
+        for (uint32_t i : te.rueda[ranura])
+            if (fotogramaDebido[i] == (uint8_t)fotograma) {
+                uint8_t& debida = columnaDebida[i / filasPlano];
+                columnasNucleo += !debida;
+                debida = 1;
+                reglas = true;
             }
+    if (reglas) {
+        for (int c = 0; c < columnas; ++c)
+            columnaDesplazar[c] = columnaDebida[c] | columnaDebida[(c + 1) % columnas]
+                                | columnaDebida[(c + columnas - 1) % columnas];
+        // el resultado no depende de los trozos, así que pueden seguir a los hilos
+        const int trozos = min(columnas, 4 * numHilos());
+        auto porTrozos = [&](const vector<uint8_t>& marcas, auto f) {
+            enParalelo(trozos, [&](int t) {
+                recorrerTramos(marcas, (int)((long)columnas * t / trozos),
+                               (int)((long)columnas * (t + 1) / trozos), f);
+            });
+        };
+        porTrozos(columnaDesplazar, [&](int a, int b) {
+            desplazarColumnas(vivas.data(), norte.data(), sur.data(), a, b, palabrasColumna, filas);
+        });
+        porTrozos(columnaDebida, [&](int a, int b) {
+            siguienteGeneracion(vivas.data(), norte.data(), sur.data(), siguientes.data(),
+                                columnas, palabrasColumna, a, b);
+        });
+    }
+
+    enParalelo((int)teselas.size(), [&](int t) { actualizarTesela(teselas[t], colorActual); });
+    for (Tesela& te : teselas) {
+        celdasTocadas   += te.celdasTocadas;
+        reglasEvaluadas += te.reglasEvaluadas;
+        te.celdasTocadas   = 0;
+        te.reglasEvaluadas = 0;
+    }
+}
+
+// Animación y reglas de las celdas de una tesela. Sólo toca sus palabras de
+// vivas y cambiadas y los bytes de sus celdas.
+void Mundo::actualizarTesela(Tesela& te, int colorActual) {
+    const uint32_t fotograma = cuentaGlobalFotogramas;
+    vector<uint32_t>& ranura = te.rueda[fotograma % tamanoRueda];
+    te.celdasTocadas += te.animando.size() + ranura.size();
+
+    // animación de tamaño de las celdas que crecen o encogen
+    for (size_t k = 0; k < te.animando.size();) {
+        const uint32_t i = te.animando[k];
+        const bool     v = vivaFisica(i);
+        uint8_t&       t = pasoTamano[i];
+        if (v && t < pasosTamano) ++t;
+        else if (!v && t > 0)     --t;
+        marcarCambiada(i);
+        if (t == (v ? pasosTamano : 0)) {
+            enAnimacion[i] = 0;
+            te.animando[k] = te.animando.back();
+            te.animando.pop_back();
+        } else {
+            ++k;
+        }
+    }
+
+    // aplicar el resultado sólo en las celdas debidas (actualizarCeldas ya
+    // ha calculado siguientes en sus columnas)
+    for (uint32_t i : ranura) {
+        if (fotogramaDebido[i] != (uint8_t)fotograma) continue;   // entrada obsoleta
+        te.reglasEvaluadas++;
+        const size_t   k   = i >> 6;
+        const uint64_t bit = 1ull << (i & 63);
+        const bool antes = vivas[k] & bit, sig = siguientes[k] & bit;
+        if (sig && !antes) {
+            vivas[k] |= bit;
+            pasoTamano[i]  = 0;
+            indiceColor[i] = (uint8_t)colorActual;
+            animar(te, i);
+            marcarCambiada(i);
+        } else if (!sig && antes) {
+            vivas[k] &= ~bit;
+            pasoTamano[i] = pasosTamano;
+            animar(te, i);
+            marcarCambiada(i);
+        } else if (!antes && nacimientoEspontaneo(te)) {
+            vivas[k] |= bit;
+            pasoTamano[i]  = 0;
+            indiceColor[i] = (uint8_t)colorActual;
+            animar(te, i);
+            marcarCambiada(i);
+        }
+        programar(te, i, fotograma + periodo[i]);
+    }
+    ranura.clear();
+}
+
+// Planos y teselas vacíos para el ancho y alto actuales
+void Mundo::prepararRejilla() {
+    const int tc = (int)cfg.tamanoCelda;
+    // Una columna más de las que caben en pantalla: la de la derecha entra
+    // desplazándose mientras la de la izquierda sale
+    columnas = (ancho + tc - 1) / tc + 1;
+    filas    = alto / tc;
 
-            // Superposición de nivel
-            if (cuentaMostrarNivel-- > 0) {
-                string niv = "Nivel " + to_string(nivel);
-                int fuente = FONT_HERSHEY_SIMPLEX;
-                double escala = 3.0;
-                int grosor = 4;
-                Size ts = getTextSize(niv,fuente,escala,grosor,nullptr);
-                Point org((ancho-ts.width)/2, (alto+ts.height)/2);
-                putText(fotograma, niv, org, fuente, escala,
-                        Scalar(255,255,255), grosor+10);
-                putText(fotograma, niv, org, fuente, escala,
-                        Scalar(0,0,0), grosor);
+    palabrasColumna = (filas + 63) / 64;
+    filasPlano      = palabrasColumna * 64;
+    const size_t totalPalabras = (size_t)columnas * palabrasColumna;
+    const size_t totalCeldas   = (size_t)columnas * filasPlano;
+    for (auto* plano : {&vivas, &zonaSinGeneracion, &cambiadas, &norte, &sur, &siguientes})
+        plano->assign(totalPalabras, 0);
+    for (auto* plano : {&pasoTamano, &fotogramaDebido, &periodo, &indiceColor, &enAnimacion})
+        plano->assign(totalCeldas, 0);
+    columnaDebida.assign(columnas, 0);
+    columnaDesplazar.assign(columnas, 0);
+    // las teselas toman sus semillas del generador del mundo
+    teselas.clear();
+    teselas.resize((size_t)(columnas + columnasTesela - 1) / columnasTesela * palabrasColumna);
+    for (Tesela& te : teselas) {
+        te.rng.seed(rng());
+        te.distEspontanea  = geometric_distribution<long>(min(1.0, max(cfg.tasaEspontanea, 1e-12)));
+        te.saltoEspontaneo = te.distEspontanea(te.rng);
+    }
+    columnaInicial = 0;
+    generacionRejilla++;
+}
+
+void Mundo::reiniciar() {
+    const double tamanoCelda = cfg.tamanoCelda;
+
+    // Mezclar los índices de la paleta
+    int totalColores = (int)coloresHex.size();
+    paleta.resize(totalColores);
+    iota(paleta.begin(), paleta.end(), 0);
+    shuffle(paleta.begin(), paleta.end(), rng);
+    indiceCicloColor = 0;
+
+    // Inicializar celdas
+    prepararRejilla();
+    cuentaGlobalFotogramas = 0;
+
+    origenX            = 0;
+    columnasRecicladas = 0;
+    for (int x = 0; x < columnas; ++x) {
+        for (int y = 0; y < filas; ++y) {
+            Point2f centro = centroCelda(x, y);
+            bool zonaCentral = fabs(centro.x - ancho/2) < tamanoCelda
+                            && fabs(centro.y - alto/2) < tamanoCelda;
+            inicializarCelda(x, y, zonaCentral);
+        }
+    }
+
+    // Ítems recuperables
+    items.clear();
+    items.reserve(cfg.capacidadItems);
+
+    // Jugador
+    jugador.pos        = Point2f(ancho/2, alto/2);
+    jugador.posAnterior = jugador.pos;
+    jugador.vel        = Point2f(0,0);
+    jugador.radio     = cfg.radioJugador;
+    jugador.enSuelo   = false;
+    jugador.mirandoDerecha= true;
+
+    cuentaGlobalFotogramas    = 0;
+    nivel               = 1;
+    cuentaMostrarNivel   = cfg.fotogramasMostrarNivel;
+    mostrarTitulo          = true;
+    cuentaMostrarTitulo   = cfg.fotogramasMostrarTitulo;
+    mostrandoNivel       = false;
+    mostrandoTitulo      = false;
+    puntuacion               = 0;
+    velocidadDesplazamiento      = cfg.velocidadDesplazamiento;
+}
+
+// Nuevo tamaño de la ventana con la partida en curso. La rejilla se rehace
+// para las columnas y filas nuevas con la columna lógica 0 en la física 0:
+// las celdas que siguen cabiendo conservan su estado y las que aparecen se
+// inicializan como una columna reciclada. El planificador se reconstruye con
+// fotogramaDebido, que guarda el fotograma (módulo 256) de la próxima regla
+// de cada celda, siempre a menos de tamanoRueda fotogramas.
+void Mundo::redimensionar(int nuevoAncho, int nuevoAlto) {
+    if (nuevoAncho == ancho && nuevoAlto == alto) return;
+    const int antesColumnas = columnas, antesFilas = filas;
+    const int antesInicial  = columnaInicial, antesPlano = filasPlano;
+    vector<uint64_t> vivasAntes = move(vivas), zonaAntes = move(zonaSinGeneracion);
+    vector<uint8_t>  tamanoAntes = move(pasoTamano), debidoAntes = move(fotogramaDebido);
+    vector<uint8_t>  periodoAntes = move(periodo), colorAntes = move(indiceColor);
+    vector<uint8_t>  animandoAntes = move(enAnimacion);
+
+    ancho = nuevoAncho;
+    alto  = nuevoAlto;
+    prepararRejilla();
+    for (int x = 0; x < columnas; ++x) {
+        for (int y = 0; y < filas; ++y) {
+            if (x >= antesColumnas || y >= antesFilas) {
+                inicializarCelda(x, y, false);
+                continue;
             }
+            const size_t   a    = (size_t)((antesInicial + x) % antesColumnas) * antesPlano + y;
+            const uint32_t i    = indiceCelda(x, y);
+            const bool     zona = (zonaAntes[a >> 6] >> (a & 63)) & 1;
+            escribirBit(vivas, x, y, (vivasAntes[a >> 6] >> (a & 63)) & 1);
+            escribirBit(zonaSinGeneracion, x, y, zona);
+            pasoTamano[i]  = tamanoAntes[a];
+            periodo[i]     = periodoAntes[a];
+            indiceColor[i] = colorAntes[a];
+            Tesela& te = teselaCelda(i);
+            if (animandoAntes[a]) animar(te, i);
+            if (!zona)
+                programar(te, i, cuentaGlobalFotogramas
+                               + (uint8_t)(debidoAntes[a] - (uint8_t)cuentaGlobalFotogramas));
+        }
+    }
+
+    // que el jugador no pierda por encoger la ventana
+    jugador.pos.x = min(jugador.pos.x, ancho - jugador.radio - 1);
+    jugador.pos.y = min(jugador.pos.y, alto  - jugador.radio - 1);
+    jugador.posAnterior = jugador.pos;
+}
+
+// Física, colisión con las celdas y recolección del ítem k; deja en
+// liberarItem[k] si hay que liberarlo
+void Mundo::moverItem(size_t k) {
+    Recuperable &itm = items[k];
+    itm.vel.y += cfg.gravedad * dt;
+    itm.pos   += itm.vel * dt;
+    // colisión con celdas
+    auto cajaItem = [&]() {
+        return Rect2f(itm.pos.x-itm.radio,
+                      itm.pos.y-itm.radio,
+                      itm.radio*2, itm.radio*2);
+    };
+    recorrerCeldasCercanas(cajaItem, [&](int x, int y) {
+        const double f = factorTamano(x, y);
+        if (f <= 0 || enZona(x, y)) return;
+        double s = cfg.tamanoCelda * f;
+        Point2f centro = centroCelda(x, y);
+        Rect2f br(centro.x - s/2, centro.y - s/2,
+                  (float)s, (float)s);
+        Rect2f ir = cajaItem();
+        if ((ir & br).area() > 0) {
+            itm.pos.y = br.y - itm.radio;
+            itm.vel.y = 0;
+        }
+    });
+    // recolección
+    float dx = itm.pos.x - jugador.pos.x;
+    float dy = itm.pos.y - jugador.pos.y;
+    uint8_t liberar = 0;
+    // fuera de pantalla por la izquierda o por debajo: ya no vuelve
+    if (itm.pos.x + itm.radio < 0 || itm.pos.y - itm.radio > alto)
+        liberar = 1;
+    if (dx*dx + dy*dy < pow(itm.radio+jugador.radio,2))
+        liberar = 2;
+    liberarItem[k] = liberar;
+}
+
+bool Mundo::paso(const Entrada& entrada) {
+    const double tamanoCelda = cfg.tamanoCelda;
+    Reloj::time_point t0;
+    if (medirFases) t0 = Reloj::now();
+
+    // Movimiento horizontal y dirección
+    if (entrada.izquierda) {
+        jugador.vel.x      = -cfg.velocidadMovimiento;
+        jugador.mirandoDerecha = false;
+    }
+    else if (entrada.derecha) {
+        jugador.vel.x      = +cfg.velocidadMovimiento;
+        jugador.mirandoDerecha = true;
+    }
+
+    // Aplicar gravedad
+    jugador.vel.y += cfg.gravedad * dt;
+
+    // Fricción
+    if (jugador.enSuelo) jugador.vel.x *= cfg.friccionSuelo;
+    else                jugador.vel.x *= cfg.friccionAire;
+
+    // Desplazar mundo
+    origenX                  -= velocidadDesplazamiento * dt;
+    for (auto& itm : items) {
+        itm.posAnterior = itm.pos;
+        itm.pos.x      -= velocidadDesplazamiento * dt;
+    }
+    jugador.posAnterior       = jugador.pos;
+    jugador.pos.x            -= velocidadDesplazamiento * dt;
 
-            // Superposición de título
-            if (mostrarTitulo && cuentaMostrarTitulo-- > 0) {
-                string t = "automata";
-                int fuente = FONT_HERSHEY_SIMPLEX;
-                double escala = 4.0;
-                int grosor = 6;
-                Size ts = getTextSize(t,fuente,escala,grosor,nullptr);
-                Point org((ancho-ts.width)/2, (alto+ts.height)/2);
-                putText(fotograma, t, org, fuente, escala,
-                        Scalar(255,255,255), grosor+20);
-                putText(fotograma, t, org, fuente, escala,
-                        Scalar(0,0,0), grosor);
-                if (cuentaMostrarTitulo == 0) mostrarTitulo = false;
+    // Aplicar velocidad
+    jugador.pos += jugador.vel * dt;
+    marcarFase(FASE_FISICA, t0);
+
+    // ===== Reciclar celdas y generar ítems =====
+    while (origenX + tamanoCelda < 0) {
+        // La columna de la izquierda salió de pantalla: pasa a ser la última
+        origenX += tamanoCelda;
+        columnaInicial = (columnaInicial + 1) % columnas;
+        columnasRecicladas++;
+        const int xNueva = columnas - 1;
+        for (int yIdx = 0; yIdx < filas; ++yIdx) {
+            // Nueva celda a la derecha
+            inicializarCelda(xNueva, yIdx, false);
+
+            // Generar ítem recuperable
+            if (items.size() >= (size_t)cfg.capacidadItems) {
+                itemsDescartados++;
+                continue;
             }
+            Recuperable itm;
+            itm.pos       = Point2f(centroCelda(xNueva, yIdx).x, yIdx*tamanoCelda);
+            itm.vel       = Point2f(0,0);
+            itm.posAnterior = itm.pos;
+            itm.radio    = cfg.radioItem;
+            items.push_back(itm);
+        }
+    }
 
-            // Superposición de puntuación
-            putText(fotograma, "Puntos: " + to_string(puntuacion),
-                    Point(10,30), FONT_HERSHEY_SIMPLEX,
-                    1.0, Scalar(255,255,255), 10);
-            putText(fotograma, "Puntuación: " + to_string(puntuacion),
-                    Point(10,30), FONT_HERSHEY_SIMPLEX,
-                    1.0, Scalar(0,0,0), 2);
+    // ===== Ciclo de nivel y color =====
+    if (cuentaGlobalFotogramas > 0
+     && cuentaGlobalFotogramas % cfg.fotogramasCambioColor == 0) {
+        indiceCicloColor = (indiceCicloColor + 1) % (int)paleta.size();
+        nivel++;
+        velocidadDesplazamiento += cfg.incrementoVelocidad;
+        cuentaMostrarNivel = cfg.fotogramasMostrarNivel;
+    }
+    int colorActual = paleta[indiceCicloColor];
+    marcarFase(FASE_RECICLAR, t0);
 
-            // Renderizar
-            SDL_UpdateTexture(textura, NULL, fotograma.data, fotograma.step);
-            SDL_RenderClear(renderizador);
-            SDL_RenderCopy(renderizador, textura, NULL, NULL);
-            SDL_RenderPresent(renderizador);
+    // ===== Actualizar celdas =====
+    actualizarCeldas(colorActual);
+    marcarFase(FASE_CELDAS, t0);
 
-            cuentaGlobalFotogramas++;
-            SDL_Delay(1000 / fps);
+    // ===== Actualizar ítems =====
+    // La física de cada ítem sólo lee la rejilla y el jugador, así que se
+    // reparte por tramos entre los hilos. La puntuación y la liberación se
+    // aplican después en orden, igual que hacía el bucle secuencial.
+    picoItems = max(picoItems, items.size());
+    liberarItem.resize(items.size());
+    const size_t porTramo = 512;
+    const int    tramos   = (int)((items.size() + porTramo - 1) / porTramo);
+    enParalelo(tramos, [&](int t) {
+        const size_t fin = min(items.size(), (t + 1) * porTramo);
+        for (size_t k = t * porTramo; k < fin; ++k) moverItem(k);
+    });
+    for (size_t k = 0; k < items.size();) {
+        if (liberarItem[k]) {
+            if (liberarItem[k] == 2) puntuacion += 10;
+            items[k]       = items.back();
+            liberarItem[k] = liberarItem.back();
+            items.pop_back();
+            liberarItem.pop_back();
+            itemsLiberados++;
+        } else {
+            ++k;
         }
     }
+    marcarFase(FASE_ITEMS, t0);
 
-    // Limpieza
-    SDL_DestroyTexture(textura);
-    SDL_DestroyRenderer(renderizador);
-    SDL_DestroyWindow(ventana);
-    SDL_Quit();
-    return 0;
+    // ===== Colisión del jugador y verificación de suelo =====
+    jugador.enSuelo = false;
+    Rect2f pr(jugador.pos.x-jugador.radio,
+              jugador.pos.y-jugador.radio,
+              jugador.radio*2, jugador.radio*2);
+    recorrerCeldasCercanas([&]() { return pr; }, [&](int x, int y) {
+        const double f = factorTamano(x, y);
+        if (f<=0 || enZona(x, y)) return;
+        double s = tamanoCelda*f;
+        Point2f centro = centroCelda(x, y);
+        Rect2f br(centro.x - s/2, centro.y - s/2,
+                  (float)s, (float)s);
+        Rect2f inter = pr & br;
+        if (inter.area()>0) {
+            if (inter.width < inter.height) {
+                jugador.pos.x += (pr.x+pr.width/2 < br.x+br.width/2)
+                              ? -inter.width : inter.width;
+                jugador.vel.x = 0;
+            } else {
+                jugador.pos.y += (pr.y+pr.height/2 < br.y+br.height/2)
+                              ? -inter.height : inter.height;
+                jugador.vel.y = 0;
+                if (pr.y+pr.height/2 < br.y+br.height/2)
+                    jugador.enSuelo = true;
+            }
+            pr = Rect2f(jugador.pos.x-jugador.radio,
+                        jugador.pos.y-jugador.radio,
+                        jugador.radio*2, jugador.radio*2);
+        }
+    });
+
+    // Salto
+    if (entrada.salto && jugador.enSuelo) {
+        jugador.vel.y = -cfg.velocidadSalto;
+        jugador.enSuelo = false;
+    }
+
+    // Superposiciones visibles en este fotograma
+    mostrandoNivel  = cuentaMostrarNivel-- > 0;
+    mostrandoTitulo = mostrarTitulo && cuentaMostrarTitulo-- > 0;
+    if (mostrandoTitulo && cuentaMostrarTitulo == 0) mostrarTitulo = false;
+    marcarFase(FASE_JUGADOR, t0);
+
+    cuentaGlobalFotogramas++;
+
+    // Condiciones de derrota
+    return !(jugador.pos.x - jugador.radio <= 0
+          || jugador.pos.y + jugador.radio >= alto);
+}
+
+// FNV-1a sobre celdas, ítems, jugador y puntuación
+uint64_t Mundo::huella() const {
+    uint64_t h = 1469598103934665603ull;
+    auto mezclar = [&](const void* datos, size_t n) {
+        const uint8_t* b = (const uint8_t*)datos;
+        for (size_t i = 0; i < n; ++i) h = (h ^ b[i]) * 1099511628211ull;
+    };
+    mezclar(vivas.data(), vivas.size() * sizeof(uint64_t));
+    mezclar(pasoTamano.data(), pasoTamano.size());
+    mezclar(indiceColor.data(), indiceColor.size());
+    mezclar(items.data(), items.size() * sizeof(Recuperable));
+    mezclar(&jugador.pos, sizeof(jugador.pos));
+    mezclar(&jugador.vel, sizeof(jugador.vel));
+    mezclar(&puntuacion, sizeof(puntuacion));
+    mezclar(&columnaInicial, sizeof(columnaInicial));
+    return h;
+}
+
+long Mundo::celdasVivas() const {
+    long n = 0;
+    for (uint64_t w : vivas) n += contarBits(w);
+    return n;
+}
+
+void Mundo::dibujar(Mat& fotograma) const {
+    dibujarCeldas(fotograma);
+    dibujarDinamico(fotograma);
+}
+
+// Rellena r, en columnas lógicas, en una capa circular en horizontal: la
+// columna lógica u está en la columna (u + origen) % capa.cols de la capa.
+// Con origen 0 es un rectángulo relleno normal. Devuelve los píxeles escritos.
+static int rellenarCircular(Mat& capa, int origen, Rect r, const Scalar& color) {
+    r = r & Rect(0, 0, capa.cols, capa.rows);
+    if (r.area() <= 0) return 0;
+    r.x += origen;
+    if (r.x >= capa.cols) r.x -= capa.cols;
+    const int derecha = min(r.width, capa.cols - r.x);
+    capa(Rect(r.x, r.y, derecha, r.height)).setTo(color);
+    if (derecha < r.width) capa(Rect(0, r.y, r.width - derecha, r.height)).setTo(color);
+    return r.area();
+}
+
+// capa puede ser BGR o de índices (ver Capa de índices), y circular con
+// origen (ver DibujoIncremental)
+int Mundo::dibujarCelda(Mat& capa, int x, int y, bool limpiar, int origen) const {
+    int escritos = 0;
+    if (limpiar) escritos += rellenarCircular(capa, origen, cuadroCelda(x, y), Scalar(255,255,255));
+    const uint8_t color = indiceColor[indiceCelda(x, y)];
+    escritos += rellenarCircular(capa, origen, rectCelda(x, y),
+                                 capa.channels() == 1 ? Scalar(color) : paletaBGR[color]);
+    return escritos;
+}
+
+long Mundo::dibujarCeldas(Mat& capa) const {
+    // ===== Dibujar fondo =====
+    capa.setTo(Scalar(255,255,255));
+
+    // ===== Dibujar celdas =====
+    long escritos = 0;
+    for (int x = 0; x < columnas; ++x)
+    for (int y = 0; y < filas; ++y)
+        escritos += dibujarCelda(capa, x, y, false);
+    return escritos;
+}
+
+// Posición en el instante alfa entre el paso anterior (0) y el último (1)
+static Point2f interpolar(const Point2f& anterior, const Point2f& actual, float alfa) {
+    return alfa >= 1 ? actual : actual + (anterior - actual) * (1 - alfa);
+}
+
+// Color del jugador según su estado; al correr parpadea cada fotograma
+static Scalar colorJugador(const Jugador& jugador, int fotogramaActual) {
+    Scalar colorJugador;
+    bool corriendo = fabs(jugador.vel.x)>0.1 && jugador.enSuelo;
+    if (!jugador.enSuelo)
+        colorJugador = jugador.mirandoDerecha
+                    ? Scalar(0,255,255)
+                    : Scalar(255,0,0);
+    else if (corriendo)
+        colorJugador = jugador.mirandoDerecha
+                    ? ((fotogramaActual%2==0)
+                        ? Scalar(0,255,0)
+                        : Scalar(255,0,255))
+                    : ((fotogramaActual%2==0)
+                        ? Scalar(0,0,255)
+                        : Scalar(255,255,0));
+    else
+        colorJugador = jugador.mirandoDerecha
+                    ? Scalar(0,255,0)
+                    : Scalar(0,0,255);
+    return colorJugador;
+}
+
+// Ítems y jugador en banda, que empieza en la fila y0 del fotograma. Los
+// centros se redondean antes de restar y0 para que cada banda pinte
+// exactamente los mismos píxeles que un dibujo de todo el fotograma.
+// escala pasa de coordenadas del mundo a píxeles del fotograma.
+static void dibujarObjetos(Mat& banda, int y0, const vector<Recuperable>& items,
+                           const Jugador& jugador, int fotogramaActual, float alfa,
+                           float escala) {
+    // ===== Dibujar ítems =====
+    for (const auto &itm : items) {
+        Point c = interpolar(itm.posAnterior, itm.pos, alfa) * escala;
+        const int r = (int)(itm.radio * escala);
+        if (c.y + r < y0 || c.y - r >= y0 + banda.rows) continue;
+        circle(banda, Point(c.x, c.y - y0), r,
+               Scalar(0,215,255), FILLED);
+    }
+
+    Point c = interpolar(jugador.posAnterior, jugador.pos, alfa) * escala;
+    circle(banda, Point(c.x, c.y - y0), (int)(jugador.radio * escala),
+           colorJugador(jugador, fotogramaActual), FILLED);
+}
+
+// Un texto con contorno: primero contorno en blanco y grueso, encima texto
+// en negro. Son cadenas distintas en el marcador de puntuación.
+struct TextoRotulo {
+    string contorno, texto;
+    Point  origen;            // línea base, como en putText
+    double escala;
+    int    grosor, grosorContorno;
+};
+
+static vector<TextoRotulo> textosRotulos(const Rotulos& r) {
+    vector<TextoRotulo> textos;
+    const int fuente = FONT_HERSHEY_SIMPLEX;
+    // tamaños y grosores a la escala del dibujo, sin bajar de un píxel
+    auto g = [&](int grosor) { return max(1, (int)lround(grosor * r.escala)); };
+    auto centrado = [&](const string& t, double escala, int grosor, int grosorContorno) {
+        escala *= r.escala;
+        Size ts = getTextSize(t,fuente,escala,g(grosor),nullptr);
+        Point org((r.ancho-ts.width)/2, (r.alto+ts.height)/2);
+        textos.push_back({t, t, org, escala, g(grosor), g(grosorContorno)});
+    };
+
+    // Superposición de nivel
+    if (r.nivelVisible) centrado("Nivel " + to_string(r.nivel), 3.0, 4, 4+10);
+
+    // Superposición de título
+    if (r.tituloVisible) centrado("automata", 4.0, 6, 6+20);
+
+    // Superposición de puntuación
+    textos.push_back({"Puntos: " + to_string(r.puntuacion),
+                      "Puntuación: " + to_string(r.puntuacion),
+                      Point((int)lround(10 * r.escala), (int)lround(30 * r.escala)),
+                      r.escala, g(2), g(10)});
+    return textos;
 }
 
+// desplazamiento se suma al origen (para dibujar en un recorte)
+static void dibujarTexto(Mat& destino, const TextoRotulo& t, Point desplazamiento,
+                         const Scalar& blanco, const Scalar& negro) {
+    const Point org = t.origen + desplazamiento;
+    putText(destino, t.contorno, org, FONT_HERSHEY_SIMPLEX, t.escala, blanco, t.grosorContorno);
+    putText(destino, t.texto,    org, FONT_HERSHEY_SIMPLEX, t.escala, negro,  t.grosor);
+}
+
+static void dibujarRotulos(Mat& fotograma, const Rotulos& r) {
+    for (const TextoRotulo& t : textosRotulos(r))
+        dibujarTexto(fotograma, t, Point(0, 0), Scalar(255,255,255), Scalar(0,0,0));
+}
+
+// Rótulos ya rasterizados. putText con trazos gruesos es caro, así que cada
+// texto se dibuja una vez (al cambiar el nivel o la puntuación) en un sprite
+// con máscara, y cada fotograma sólo se copia la máscara. Sin suavizado los
+// píxeles son exactamente los de putText; dibujarRotulos, que sigue usando
+// putText, sirve de referencia en --comprobar-dibujo.
+struct SpriteTexto {
+    TextoRotulo fuente;     // el origen no cuenta: el sprite es relativo a él
+    Rect        caja;       // respecto al origen del texto
+    Mat         color, mascara;
+    Mat         bgra;       // color con la máscara como alfa, para texturas
+    unsigned    version = 0;
+    long        uso     = 0;
+};
+
+struct CacheRotulos {
+    static constexpr size_t capacidad = 8;
+
+    void dibujar(Mat& fotograma, const Rotulos& r);
+    const SpriteTexto& sprite(const TextoRotulo& t);
+
+private:
+    vector<SpriteTexto> sprites;
+    long                usos      = 0;
+    unsigned            versiones = 0;
+};
+
+const SpriteTexto& CacheRotulos::sprite(const TextoRotulo& t) {
+    ++usos;
+    for (SpriteTexto& s : sprites)
+        if (s.fuente.texto == t.texto && s.fuente.contorno == t.contorno && s.fuente.escala == t.escala
+         && s.fuente.grosor == t.grosor && s.fuente.grosorContorno == t.grosorContorno) {
+            s.uso = usos;
+            return s;
+        }
+
+    // Nuevo, en el hueco usado hace más tiempo
+    if (sprites.size() < capacidad) sprites.emplace_back();
+    SpriteTexto& s = *min_element(sprites.begin(), sprites.end(),
+                                  [](const SpriteTexto& a, const SpriteTexto& b) { return a.uso < b.uso; });
+    int base = 0;
+    const Size ts     = getTextSize(t.contorno, FONT_HERSHEY_SIMPLEX, t.escala, t.grosorContorno, &base);
+    const Size tt     = getTextSize(t.texto, FONT_HERSHEY_SIMPLEX, t.escala, t.grosor, nullptr);
+    const int  alto   = max(ts.height, tt.height);
+    const int  margen = t.grosorContorno;
+    s.fuente  = t;
+    s.caja    = Rect(-margen, -alto - margen, max(ts.width, tt.width) + 2 * margen, alto + base + 2 * margen);
+    s.version = ++versiones;
+    s.uso     = usos;
+    s.color.create(s.caja.height, s.caja.width, CV_8UC3);
+    s.mascara.create(s.caja.height, s.caja.width, CV_8UC1);
+    s.color.setTo(Scalar(0, 0, 0));
+    s.mascara.setTo(Scalar(0));
+    const Point aSprite(-s.caja.x - t.origen.x, -s.caja.y - t.origen.y);
+    dibujarTexto(s.color,   t, aSprite, Scalar(255,255,255), Scalar(0,0,0));
+    dibujarTexto(s.mascara, t, aSprite, Scalar(255), Scalar(255));
+    s.bgra.create(s.caja.height, s.caja.width, CV_8UC4);
+    for (int y = 0; y < s.caja.height; ++y) {
+        const uchar* c = s.color.ptr<uchar>(y);
+        const uchar* m = s.mascara.ptr<uchar>(y);
+        uchar*       d = s.bgra.ptr<uchar>(y);
+        for (int x = 0; x < s.caja.width; ++x) {
+            d[4*x] = c[3*x]; d[4*x+1] = c[3*x+1]; d[4*x+2] = c[3*x+2]; d[4*x+3] = m[x];
+        }
+    }
+    return s;
+}
+
+void CacheRotulos::dibujar(Mat& fotograma, const Rotulos& r) {
+    for (const TextoRotulo& t : textosRotulos(r)) {
+        const SpriteTexto& s = sprite(t);
+        const Rect destino(t.origen.x + s.caja.x, t.origen.y + s.caja.y, s.caja.width, s.caja.height);
+        const Rect visible = destino & Rect(0, 0, fotograma.cols, fotograma.rows);
+        if (visible.area() <= 0) continue;
+        const Rect enSprite(visible.x - destino.x, visible.y - destino.y, visible.width, visible.height);
+        Mat roi = fotograma(visible);
+        s.color(enSprite).copyTo(roi, s.mascara(enSprite));
+    }
+}
+
+// Ítems, jugador y superposiciones: lo que cambia en todos los fotogramas
+void Mundo::dibujarDinamico(Mat& fotograma) const {
+    dibujarItemsJugador(fotograma, 0);
+    dibujarTextos(fotograma);
+}
+
+void Mundo::dibujarItemsJugador(Mat& banda, int y0) const {
+    // El contador ya avanzó en paso(); el parpadeo usa el del fotograma dibujado
+    dibujarObjetos(banda, y0, items, jugador, cuentaGlobalFotogramas - 1, 1.0f, escalaDibujo());
+}
+
+void Mundo::dibujarTextos(Mat& fotograma) const {
+    dibujarRotulos(fotograma, rotulos());
+}
+
+Rotulos Mundo::rotulos() const {
+    Rotulos r;
+    r.ancho         = anchoDibujo();
+    r.alto          = altoDibujo();
+    r.escala        = escalaDibujo();
+    r.nivel         = nivel;
+    r.puntuacion    = puntuacion;
+    r.nivelVisible  = mostrandoNivel;
+    r.tituloVisible = mostrandoTitulo;
+    return r;
+}
+
+// ======== Dibujo incremental ========
+// Guarda en capa las celdas ya dibujadas. La capa es circular en horizontal:
+// la columna 0 del fotograma está en la columna origen de la capa, así que
+// desplazarla lo que haya avanzado el desplazamiento en píxeles es mover el
+// origen, sin copiar nada. Cada fotograma dibuja las columnas que entran por
+// la derecha y las celdas marcadas en Mundo::cambiadas, y copia la capa al
+// fotograma en dos tramos, a partir del origen y desde el principio, antes de
+// ítems, jugador y textos. El resultado es idéntico píxel a píxel al de
+// Mundo::dibujar (--comprobar-dibujo lo verifica).
+// La capa es de índices salvo con indexada a false; entonces es BGR, como
+// el fotograma, y se copia tal cual en vez de expandirse.
+//
+// Con varios hilos el fotograma se reparte en bandas horizontales cuyo alto
+// es múltiplo del tamaño de celda: cada celda cae entera en una banda y cada
+// hilo sólo escribe filas de la suya. Los textos se dibujan al final, encima.
+struct DibujoIncremental {
+    Mat      capa;
+    int      origen                 = 0;   // columna de la capa con la columna 0 del fotograma
+    long     desplazamientoDibujado = 0;
+    unsigned generacion             = 0;
+    int      celda                  = 0;   // Mundo::celdaDibujo de la capa
+    bool     valida                 = false;
+    bool     indexada               = true;  // un byte por píxel (índice) o tres (BGR)
+    double   bytesEscritos          = 0;     // en la capa y el fotograma, acumulado
+    CacheRotulos rotulos;
+
+    void actualizar(Mundo& m);                // sólo la capa de celdas
+    void dibujar(Mundo& m, Mat& fotograma);   // capa, ítems, jugador y textos
+
+private:
+    vector<long> bytesBanda;   // escritos por cada banda en actualizar()
+
+    int  altoBanda(const Mundo& m) const;
+    long desplazar(const Mundo& m, int delta, int y0, int y1);
+    long dibujarCambiadas(const Mundo& m, int y0, int y1);
+};
+
+// n píxeles de la fila y de una capa circular, desde la columna lógica u, a
+// destino en BGR: expandidos si la capa es de índices, copiados si es BGR
+static void copiarCircular(const Mat& capa, int origen, int y, int u, int n, uchar* destino) {
+    const size_t bytesPix = capa.elemSize();
+    int x = u + origen;
+    if (x >= capa.cols) x -= capa.cols;
+    while (n > 0) {
+        const int    tramo = min(n, capa.cols - x);
+        const uchar* p     = capa.ptr<uchar>(y) + x * bytesPix;
+        if (bytesPix == 1) expandirIndices(p, destino, tramo);
+        else               memcpy(destino, p, tramo * bytesPix);
+        destino += tramo * 3;
+        n       -= tramo;
+        x        = 0;
+    }
+}
+
+// Columnas que entran por la derecha tras mover el origen delta píxeles
+long DibujoIncremental::desplazar(const Mundo& m, int delta, int y0, int y1) {
+    const int tc       = m.celdaDibujo;
+    const int filasPix = min(y1, m.filas * tc);   // debajo sólo hay blanco
+    const int x0       = capa.cols - delta;
+    long escritos = rellenarCircular(capa, origen, Rect(x0, y0, delta, filasPix - y0),
+                                     Scalar(255,255,255));
+    const int filaFin = min(m.filas, (y1 + tc - 1) / tc);
+    for (int x = 0; x < m.columnas; ++x) {
+        const Rect c = m.cuadroCelda(x, 0);
+        if (c.x + c.width <= x0 || c.x >= capa.cols) continue;
+        for (int y = y0 / tc; y < filaFin; ++y) escritos += m.dibujarCelda(capa, x, y, false, origen);
+    }
+    return escritos * (long)capa.elemSize();
+}
+
+// Celdas marcadas cuyas filas caen en [y0, y1) píxeles. No borra las marcas:
+// las palabras de cambiadas se comparten entre bandas.
+long DibujoIncremental::dibujarCambiadas(const Mundo& m, int y0, int y1) {
+    const int tc       = m.celdaDibujo;
+    const int filaIni  = y0 / tc;
+    const int filaFin  = min(m.filas, (y1 + tc - 1) / tc);
+    long      escritos = 0;
+    if (filaIni >= filaFin) return 0;
+    for (int p = 0; p < m.columnas; ++p) {
+        const int x = (p - m.columnaInicial + m.columnas) % m.columnas;
+        const uint64_t* col = &m.cambiadas[(size_t)p * m.palabrasColumna];
+        for (int i = filaIni >> 6; i <= (filaFin - 1) >> 6; ++i) {
+            uint64_t w = col[i];
+            if (i == filaIni >> 6)       w &= ~0ull << (filaIni & 63);
+            if (i == (filaFin - 1) >> 6) w &= ~0ull >> (63 - ((filaFin - 1) & 63));
+            for (; w; w &= w - 1)
+                escritos += m.dibujarCelda(capa, x, i * 64 + bitMasBajo(w), true, origen);
+        }
+    }
+    return escritos * (long)capa.elemSize();
+}
+
+// Alto de las bandas: múltiplo del tamaño de celda, unas dos por hilo
+int DibujoIncremental::altoBanda(const Mundo& m) const {
+    const int tc       = m.celdaDibujo;
+    const int deseadas = m.numHilos() > 1 ? 2 * m.numHilos() : 1;
+    return ((m.altoDibujo() + deseadas - 1) / deseadas + tc - 1) / tc * tc;
+}
+
+void DibujoIncremental::actualizar(Mundo& m) {
+    const long desp  = m.desplazamientoPixeles();
+    const long delta = desp - desplazamientoDibujado;
+    const int  tipo  = indexada ? CV_8UC1 : CV_8UC3;
+    if (!valida || generacion != m.generacionRejilla || celda != m.celdaDibujo
+     || capa.cols != m.anchoDibujo() || capa.rows != m.altoDibujo() || capa.type() != tipo
+     || delta < 0 || delta >= capa.cols) {
+        capa.create(m.altoDibujo(), m.anchoDibujo(), tipo);
+        bytesEscritos += (double)(capa.total() + m.dibujarCeldas(capa)) * capa.elemSize();
+        origen     = 0;
+        valida     = true;
+        generacion = m.generacionRejilla;
+        celda      = m.celdaDibujo;
+    } else {
+        const int alto   = altoBanda(m);
+        const int bandas = (capa.rows + alto - 1) / alto;
+        origen = (int)((origen + delta) % capa.cols);
+        bytesBanda.assign(bandas, 0);
+        m.enParalelo(bandas, [&](int b) {
+            const int y0 = b * alto, y1 = min(capa.rows, y0 + alto);
+            if (delta > 0) bytesBanda[b] += desplazar(m, (int)delta, y0, y1);
+            bytesBanda[b] += dibujarCambiadas(m, y0, y1);
+        });
+        for (long n : bytesBanda) bytesEscritos += n;
+    }
+    fill(m.cambiadas.begin(), m.cambiadas.end(), 0);
+    desplazamientoDibujado = desp;
+}
+
+void DibujoIncremental::dibujar(Mundo& m, Mat& fotograma) {
+    actualizar(m);
+    fotograma.create(capa.rows, capa.cols, CV_8UC3);
+    bytesEscritos += (double)fotograma.total() * 3;
+    const int alto = altoBanda(m);
+    m.enParalelo((capa.rows + alto - 1) / alto, [&](int b) {
+        const int y0 = b * alto, y1 = min(capa.rows, y0 + alto);
+        for (int y = y0; y < y1; ++y)
+            copiarCircular(capa, origen, y, 0, capa.cols, fotograma.ptr<uchar>(y));
+        Mat roi = fotograma(Rect(0, y0, fotograma.cols, y1 - y0));
+        m.dibujarItemsJugador(roi, y0);
+    });
+    rotulos.dibujar(fotograma, m.rotulos());
+}
+
+// ======== Perfil por fotograma ========
+// Dónde se va el tiempo de cada fotograma: duración de cada fase, percentiles
+// de una ventana móvil para el HUD y, si se pide, un registro por fotograma
+// en CSV, JSON o formato de traza de Chrome (chrome://tracing o Perfetto).
+// Desactivado no lee el reloj: cada medida sólo comprueba un puntero.
+
+// Últimas muestras de una serie, para percentiles de una ventana móvil
+struct SerieMovil {
+    static constexpr size_t capacidad = 1024;
+
+    struct Resumen { double p50 = 0, p99 = 0, maximo = 0; };
+
+    void anotar(float v) {
+        if (muestras.size() < capacidad) muestras.push_back(v);
+        else                             muestras[siguiente] = v;
+        siguiente = (siguiente + 1) % capacidad;
+    }
+    bool    vacia() const { return muestras.empty(); }
+    Resumen resumen() const;
+
+private:
+    vector<float>         muestras;
+    size_t                siguiente = 0;
+    mutable vector<float> orden;
+};
+
+SerieMovil::Resumen SerieMovil::resumen() const {
+    Resumen r;
+    if (muestras.empty()) return r;
+    orden.assign(muestras.begin(), muestras.end());
+    auto percentil = [&](double p) {
+        const size_t k = min(orden.size() - 1, (size_t)(p * orden.size()));
+        nth_element(orden.begin(), orden.begin() + k, orden.end());
+        return (double)orden[k];
+    };
+    r.p50    = percentil(0.50);
+    r.p99    = percentil(0.99);
+    r.maximo = *max_element(orden.begin(), orden.end());
+    return r;
+}
+
+enum FormatoPerfil { PERFIL_CSV, PERFIL_JSON, PERFIL_CHROME };
+static const char* nombresFormatoPerfil[] = { "csv", "json", "chrome" };
+
+// Lo usa un solo hilo: las fases del hilo de simulación le llegan ya medidas
+// con cada instantánea (anotarTanda).
+struct Perfil {
+    static constexpr int hiloPresentacion = 1, hiloSimulacion = 2;   // tid en la traza
+    static constexpr int refrescoHud      = 15;   // fotogramas entre recálculos del HUD
+
+    bool activo     = false;   // sin él MedidaFase no mide nada
+    bool hudVisible = false;
+
+    bool abrir(const string& fichero, FormatoPerfil f);
+    void cerrar();
+    bool exportando() const { return salida.is_open(); }
+
+    // Tramo de una fase en el fotograma en curso
+    void anotar(Fase f, Reloj::time_point inicio, Reloj::time_point fin) {
+        anotarNs(f, inicio, chrono::duration<double, nano>(fin - inicio).count(), hiloPresentacion);
+    }
+    // Tanda de pasos del mundo: sus fases se colocan seguidas desde inicio
+    void anotarTanda(const double* ns, Reloj::time_point inicio, int pasosTanda,
+                     long celdasVivas, long numItems, long reglasTanda);
+    void cerrarFotograma();
+
+    const Mat& hud() const        { return panel; }
+    unsigned   versionHud() const { return versionPanel; }
+    void       imprimirResumen(ostream& os) const;
+
+private:
+    struct Tramo { Fase fase; Reloj::time_point inicio; double ns; int hilo; };
+
+    ofstream          salida;
+    FormatoPerfil     formato = PERFIL_CSV;
+    Reloj::time_point origen  = Reloj::now();
+    long              fotogramas = 0;
+
+    // Fotograma en curso; vivas e items se quedan con el último valor
+    vector<Tramo> tramos;                 // sólo para la traza
+    double        nsFase[NUM_FASES] = {};
+    bool          medida[NUM_FASES] = {};
+    int           pasos  = 0;
+    long          vivas  = 0, items = 0, reglas = 0;
+
+    SerieMovil series[NUM_FASES];
+    Mat        panel;
+    unsigned   versionPanel = 0;
+
+    void   anotarNs(Fase f, Reloj::time_point inicio, double ns, int hilo);
+    void   escribirRegistro();
+    void   dibujarHud();
+    double microsegundos(Reloj::time_point t) const {
+        return chrono::duration<double, micro>(t - origen).count();
+    }
+};
+
+// Mide una fase desde su construcción hasta el final del ámbito, o hasta
+// terminar() si acaba antes
+struct MedidaFase {
+    MedidaFase(Perfil* p, Fase f) : perfil(p && p->activo ? p : nullptr), fase(f) {
+        if (perfil) inicio = Reloj::now();
+    }
+    ~MedidaFase() { terminar(); }
+    void terminar() {
+        if (perfil) perfil->anotar(fase, inicio, Reloj::now());
+        perfil = nullptr;
+    }
+
+private:
+    Perfil*           perfil;
+    Fase              fase;
+    Reloj::time_point inicio;
+};
+
+bool Perfil::abrir(const string& fichero, FormatoPerfil f) {
+    salida.open(fichero);
+    if (!salida) {
+        cerr << "No se puede escribir " << fichero << endl;
+        return false;
+    }
+    formato = f;
+    salida << fixed << setprecision(3);
+    if (formato == PERFIL_CSV) {
+        salida << "fotograma,t_us,pasos";
+        for (int k = 0; k < NUM_FASES; ++k) salida << ",ns_" << nombresFase[k];
+        salida << ",celdas_vivas,items,reglas\n";
+    } else if (formato == PERFIL_JSON) {
+        salida << "[";
+    } else {
+        // Formato de lista de eventos: se puede abrir aunque falte el cierre
+        salida << "[{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << hiloPresentacion
+               << ",\"args\":{\"name\":\"presentacion\"}},\n"
+               << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << hiloSimulacion
+               << ",\"args\":{\"name\":\"simulacion\"}}";
+    }
+    return true;
+}
+
+void Perfil::cerrar() {
+    if (!salida.is_open()) return;
+    if (formato != PERFIL_CSV) salida << "\n]\n";
+    salida.close();
+}
+
+void Perfil::anotarNs(Fase f, Reloj::time_point inicio, double ns, int hilo) {
+    nsFase[f] += ns;
+    medida[f]  = true;
+    if (formato == PERFIL_CHROME && salida.is_open()) tramos.push_back({f, inicio, ns, hilo});
+}
+
+void Perfil::anotarTanda(const double* ns, Reloj::time_point inicio, int pasosTanda,
+                         long celdasVivas, long numItems, long reglasTanda) {
+    for (int f = 0; f < NUM_FASES_MUNDO; ++f) {
+        if (ns[f] <= 0) continue;   // fase que no se ejecutó (sin dibujo)
+        anotarNs((Fase)f, inicio, ns[f], hiloSimulacion);
+        inicio += chrono::duration_cast<Reloj::duration>(chrono::duration<double, nano>(ns[f]));
+    }
+    pasos  += pasosTanda;
+    vivas   = celdasVivas;
+    items   = numItems;
+    reglas += reglasTanda;
+}
+
+void Perfil::cerrarFotograma() {
+    for (int f = 0; f < NUM_FASES; ++f)
+        if (medida[f]) series[f].anotar((float)nsFase[f]);
+    if (salida.is_open()) escribirRegistro();
+    if (hudVisible && (panel.empty() || fotogramas % refrescoHud == 0)) dibujarHud();
+    fotogramas++;
+    fill(begin(nsFase), end(nsFase), 0.0);
+    fill(begin(medida), end(medida), false);
+    tramos.clear();
+    pasos  = 0;
+    reglas = 0;
+}
+
+void Perfil::escribirRegistro() {
+    const double t = microsegundos(Reloj::now());
+    if (formato == PERFIL_CSV) {
+        salida << fotogramas << "," << t << "," << pasos;
+        for (int f = 0; f < NUM_FASES; ++f) salida << "," << (long)nsFase[f];
+        salida << "," << vivas << "," << items << "," << reglas << "\n";
+    } else if (formato == PERFIL_JSON) {
+        salida << (fotogramas ? ",\n" : "\n")
+               << "{\"fotograma\":" << fotogramas << ",\"t_us\":" << t << ",\"pasos\":" << pasos << ",\"ns\":{";
+        bool primera = true;
+        for (int f = 0; f < NUM_FASES; ++f) {
+            if (!medida[f]) continue;
+            salida << (primera ? "" : ",") << "\"" << nombresFase[f] << "\":" << (long)nsFase[f];
+            primera = false;
+        }
+        salida << "},\"celdas_vivas\":" << vivas << ",\"items\":" << items
+               << ",\"reglas\":" << reglas << "}";
+    } else {
+        for (const Tramo& tr : tramos)
+            salida << ",\n{\"name\":\"" << nombresFase[tr.fase] << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                   << tr.hilo << ",\"ts\":" << microsegundos(tr.inicio) << ",\"dur\":" << tr.ns / 1000 << "}";
+        salida << ",\n{\"name\":\"contadores\",\"ph\":\"C\",\"pid\":1,\"ts\":" << t
+               << ",\"args\":{\"celdas_vivas\":" << vivas << ",\"items\":" << items
+               << ",\"reglas\":" << reglas << "}}";
+    }
+}
+
+// Tabla de p50, p99 y máximo por fase en microsegundos, con los contadores
+void Perfil::dibujarHud() {
+    const int alto = 16;
+    int filas = 3;
+    for (const SerieMovil& sm : series) filas += !sm.vacia();
+    panel.create(filas * alto + 6, 290, CV_8UC3);
+    panel.setTo(Scalar(40, 40, 40));
+
+    const Scalar blanco(255, 255, 255);
+    const int    columnas[] = {6, 110, 170, 230};
+    int          y = alto;
+    auto fila = [&](const string* textos) {
+        for (int k = 0; k < 4; ++k)
+            putText(panel, textos[k], Point(columnas[k], y), FONT_HERSHEY_PLAIN, 1.0, blanco, 1);
+        y += alto;
+    };
+    auto us = [](double ns) {
+        ostringstream os;
+        os << fixed << setprecision(ns < 10000 ? 1 : 0) << ns / 1000;
+        return os.str();
+    };
+    const string cabecera[] = {"fase (us)", "p50", "p99", "max"};
+    fila(cabecera);
+    for (int f = 0; f < NUM_FASES; ++f) {
+        if (series[f].vacia()) continue;
+        const SerieMovil::Resumen r = series[f].resumen();
+        const string textos[] = {nombresFase[f], us(r.p50), us(r.p99), us(r.maximo)};
+        fila(textos);
+    }
+    putText(panel, "vivas " + to_string(vivas) + "  items " + to_string(items),
+            Point(columnas[0], y), FONT_HERSHEY_PLAIN, 1.0, blanco, 1);
+    y += alto;
+    putText(panel, "reglas " + to_string(reglas) + "  (F3 oculta)",
+            Point(columnas[0], y), FONT_HERSHEY_PLAIN, 1.0, blanco, 1);
+    versionPanel++;
+}
+
+void Perfil::imprimirResumen(ostream& os) const {
+    if (none_of(begin(series), end(series), [](const SerieMovil& sm) { return !sm.vacia(); })) return;
+    os << fixed << setprecision(1) << "fases en us, últimos " << SerieMovil::capacidad
+       << " fotogramas:        p50      p99      max\n";
+    for (int f = 0; f < NUM_FASES; ++f) {
+        if (series[f].vacia()) continue;
+        const SerieMovil::Resumen r = series[f].resumen();
+        os << "  " << setw(10) << nombresFase[f] << ": " << setw(9) << r.p50 / 1000
+           << setw(9) << r.p99 / 1000 << setw(9) << r.maximo / 1000 << "\n";
+    }
+}
+
+// El HUD en la esquina superior derecha del fotograma
+static void superponerHud(Mat& fotograma, const Mat& panel) {
+    const Rect destino = Rect(fotograma.cols - panel.cols - 10, 10, panel.cols, panel.rows)
+                       & Rect(0, 0, fotograma.cols, fotograma.rows);
+    if (destino.area() <= 0) return;
+    Mat roi = fotograma(destino);
+    panel(Rect(destino.x - (fotograma.cols - panel.cols - 10), destino.y - 10,
+               destino.width, destino.height)).copyTo(roi);
+}
+
+// ======== Capturas del mundo ========
+// Una captura es la imagen plana de todo el estado de la partida: rejilla,
+// planificador, ítems, jugador, generadores, paleta y contadores de nivel.
+// Se arma en memoria con copias enteras de cada plano y se escribe con un
+// solo write(). Para restaurarla se proyecta el fichero con mmap y cada
+// bloque se copia de una vez a un Mundo nuevo, que se comprueba entero y
+// sólo entonces sustituye al actual; así que cada restauración reserva de
+// nuevo todos los planos y las ruedas de las teselas. Es una pausa que se
+// pide a mano (F9, --restaurar), no algo de cada paso.
+//
+// Formato: CabeceraCaptura y después bloques en un orden fijo, cada uno
+// alineado a 8 bytes; los de longitud variable llevan delante su número de
+// elementos (uint64). Los generadores, los ítems y el jugador van tal como
+// están en memoria, así que una captura sólo sirve para el mismo programa en
+// la misma máquina: la cabecera guarda los tamaños y el orden de bytes para
+// rechazar las demás.
+
+static const char marcaCaptura[8] = {'A', 'U', 'T', 'O', 'S', 'N', 'A', 'P'};
+static constexpr uint32_t versionCaptura = 2;   // 2: una rueda por tesela en vez de por franja
+
+static_assert(is_trivially_copyable<mt19937>::value, "mt19937 se copia tal cual a las capturas");
+static_assert(is_trivially_copyable<ConfiguracionJuego>::value, "la configuración se copia tal cual");
+
+struct CabeceraCaptura {
+    char     marca[8];
+    uint32_t version;
+    uint32_t ordenBytes;          // 0x01020304 escrito por esta máquina
+    uint32_t bytesGenerador;      // sizeof(mt19937)
+    uint32_t bytesItem;           // sizeof(Recuperable)
+    uint32_t bytesJugador;        // sizeof(Jugador)
+    uint32_t bytesConfiguracion;  // sizeof(ConfiguracionJuego)
+    uint64_t bytesTotales;        // del fichero entero
+};
+
+// Los escalares del mundo, en un bloque
+struct EscalaresCaptura {
+    int32_t ancho, alto, columnas, filas, palabrasColumna, filasPlano;
+    int32_t columnaInicial, indiceCicloColor;
+    int64_t columnasRecicladas;
+    double  origenX, velocidadDesplazamiento;
+    int32_t cuentaGlobalFotogramas, nivel, cuentaMostrarNivel, cuentaMostrarTitulo, puntuacion;
+    uint8_t mostrarTitulo, mostrandoNivel, mostrandoTitulo;
+    int64_t picoItems, itemsLiberados, itemsDescartados, celdasTocadas, reglasEvaluadas;
+};
+
+// Lo que tiene una tesela además de sus listas
+struct TeselaCaptura {
+    int64_t  saltoEspontaneo, celdasTocadas, reglasEvaluadas;
+    uint32_t longitudRueda[Mundo::tamanoRueda];
+    uint32_t longitudAnimando;
+};
+
+static CabeceraCaptura cabeceraCapturaLocal() {
+    CabeceraCaptura c;
+    memset(&c, 0, sizeof(c));   // también el relleno, que va al fichero
+    memcpy(c.marca, marcaCaptura, sizeof(c.marca));
+    c.version            = versionCaptura;
+    c.ordenBytes         = 0x01020304;
+    c.bytesGenerador     = sizeof(mt19937);
+    c.bytesItem          = sizeof(Recuperable);
+    c.bytesJugador       = sizeof(Jugador);
+    c.bytesConfiguracion = sizeof(ConfiguracionJuego);
+    return c;
+}
+
+static size_t alinear8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+// Añade bloques al final de bytes
+struct EscritorCaptura {
+    vector<char>& bytes;
+
+    void anadir(const void* datos, size_t n) {
+        const size_t i = bytes.size();
+        bytes.resize(i + alinear8(n));
+        if (n) memcpy(&bytes[i], datos, n);
+    }
+    template <class T>
+    void anadirVector(const vector<T>& v) {
+        const uint64_t n = v.size();
+        anadir(&n, sizeof(n));
+        anadir(v.data(), v.size() * sizeof(T));
+    }
+};
+
+// Lee bloques de una captura ya en memoria, sin salirse de ella
+struct LectorCaptura {
+    const char* p;
+    const char* fin;
+
+    bool leer(void* destino, size_t n) {
+        if ((size_t)(fin - p) < alinear8(n)) return false;
+        if (n) memcpy(destino, p, n);
+        p += alinear8(n);
+        return true;
+    }
+    template <class T>
+    bool leerVector(vector<T>& v) {
+        uint64_t n;
+        if (!leer(&n, sizeof(n)) || n > (uint64_t)(fin - p) / sizeof(T)) return false;
+        v.resize((size_t)n);
+        return leer(v.data(), (size_t)n * sizeof(T));
+    }
+};
+
+void Mundo::capturar(vector<char>& bytes) const {
+    // todo el tamaño de una vez, para que la primera no vaya creciendo a trozos
+    size_t total = 4096 + paleta.size() * sizeof(int) + items.size() * sizeof(Recuperable)
+                 + (vivas.size() + zonaSinGeneracion.size()) * sizeof(uint64_t) + 5 * pasoTamano.size();
+    for (const Tesela& te : teselas) {
+        total += sizeof(TeselaCaptura) + sizeof(te.rng) + 8 * (tamanoRueda + 1)
+               + te.animando.size() * sizeof(uint32_t);
+        for (const auto& ranura : te.rueda) total += ranura.size() * sizeof(uint32_t);
+    }
+    bytes.clear();
+    bytes.reserve(total);
+    EscritorCaptura e{bytes};
+    CabeceraCaptura cabecera = cabeceraCapturaLocal();
+    e.anadir(&cabecera, sizeof(cabecera));
+
+    EscalaresCaptura s;
+    memset(&s, 0, sizeof(s));
+    s.ancho = ancho;  s.alto = alto;  s.columnas = columnas;  s.filas = filas;
+    s.palabrasColumna = palabrasColumna;  s.filasPlano = filasPlano;
+    s.columnaInicial  = columnaInicial;   s.indiceCicloColor = indiceCicloColor;
+    s.columnasRecicladas      = columnasRecicladas;
+    s.origenX                 = origenX;
+    s.velocidadDesplazamiento = velocidadDesplazamiento;
+    s.cuentaGlobalFotogramas  = cuentaGlobalFotogramas;
+    s.nivel                   = nivel;
+    s.cuentaMostrarNivel      = cuentaMostrarNivel;
+    s.cuentaMostrarTitulo     = cuentaMostrarTitulo;
+    s.puntuacion              = puntuacion;
+    s.mostrarTitulo           = mostrarTitulo;
+    s.mostrandoNivel          = mostrandoNivel;
+    s.mostrandoTitulo         = mostrandoTitulo;
+    s.picoItems               = (int64_t)picoItems;
+    s.itemsLiberados          = itemsLiberados;
+    s.itemsDescartados        = itemsDescartados;
+    s.celdasTocadas           = celdasTocadas;
+    s.reglasEvaluadas         = reglasEvaluadas;
+    e.anadir(&s, sizeof(s));
+    e.anadir(&cfg, sizeof(cfg));
+    e.anadir(&rng, sizeof(rng));
+    e.anadirVector(paleta);
+
+    for (auto* plano : {&vivas, &zonaSinGeneracion}) e.anadirVector(*plano);
+    for (auto* plano : {&pasoTamano, &fotogramaDebido, &periodo, &indiceColor, &enAnimacion})
+        e.anadirVector(*plano);
+
+    for (const Tesela& te : teselas) {
+        TeselaCaptura f;
+        memset(&f, 0, sizeof(f));
+        f.saltoEspontaneo  = te.saltoEspontaneo;
+        f.celdasTocadas    = te.celdasTocadas;
+        f.reglasEvaluadas  = te.reglasEvaluadas;
+        for (int k = 0; k < tamanoRueda; ++k) f.longitudRueda[k] = (uint32_t)te.rueda[k].size();
+        f.longitudAnimando = (uint32_t)te.animando.size();
+        e.anadir(&f, sizeof(f));
+        e.anadir(&te.rng, sizeof(te.rng));
+        // el orden dentro de cada ranura decide el de los sorteos: va tal cual
+        for (int k = 0; k < tamanoRueda; ++k)
+            e.anadir(te.rueda[k].data(), te.rueda[k].size() * sizeof(uint32_t));
+        e.anadir(te.animando.data(), te.animando.size() * sizeof(uint32_t));
+    }
+
+    e.anadirVector(items);
+    e.anadir(&jugador, sizeof(jugador));
+
+    CabeceraCaptura* c = (CabeceraCaptura*)bytes.data();
+    c->bytesTotales = bytes.size();
+}
+
+bool Mundo::restaurar(const char* datos, size_t n) {
+    LectorCaptura l{datos, datos + n};
+    CabeceraCaptura c, local = cabeceraCapturaLocal();
+    if (!l.leer(&c, sizeof(c))) return false;
+    local.bytesTotales = n;
+    if (memcmp(&c, &local, sizeof(c)) != 0) return false;
+
+    // Se decodifica en un mundo aparte y sólo se cambia por este si todo
+    // cuadra: con una captura dañada la partida en curso sigue intacta
+    Mundo t{SinRejilla{}};
+    if (!t.decodificar(l)) return false;
+
+    // lo que no va en la captura es de esta sesión
+    t.hilos          = hilos;
+    t.medirFases     = medirFases;
+    copy(begin(nsFase), end(nsFase), t.nsFase);
+    t.columnasNucleo = columnasNucleo;
+    t.faseAmplia     = faseAmplia;
+    t.celdaDibujo    = max(1, min(celdaDibujo, (int)t.cfg.tamanoCelda));
+    t.generacionRejilla = generacionRejilla + 1;
+    *this = move(t);
+    return true;
+}
+
+// Lee el resto de la captura tras la cabecera. Todo lo que luego se usa como
+// índice o divisor se comprueba aquí: la configuración contra sus rangos, la
+// forma de la rejilla contra ancho, alto y tamanoCelda, y cada entrada de la
+// paleta, de los planos y de las listas de las teselas contra lo que indexa.
+bool Mundo::decodificar(LectorCaptura& l) {
+    EscalaresCaptura s;
+    if (!l.leer(&s, sizeof(s)) || !l.leer(&cfg, sizeof(cfg)) || !l.leer(&rng, sizeof(rng))
+     || !l.leerVector(paleta)) return false;
+    if (!configuracionValida(cfg)) return false;
+    ancho = s.ancho;  alto = s.alto;  columnas = s.columnas;  filas = s.filas;
+    palabrasColumna = s.palabrasColumna;  filasPlano = s.filasPlano;
+    columnaInicial  = s.columnaInicial;   indiceCicloColor = s.indiceCicloColor;
+    columnasRecicladas      = s.columnasRecicladas;
+    origenX                 = s.origenX;
+    velocidadDesplazamiento = s.velocidadDesplazamiento;
+    cuentaGlobalFotogramas  = s.cuentaGlobalFotogramas;
+    nivel                   = s.nivel;
+    cuentaMostrarNivel      = s.cuentaMostrarNivel;
+    cuentaMostrarTitulo     = s.cuentaMostrarTitulo;
+    puntuacion              = s.puntuacion;
+    mostrarTitulo           = s.mostrarTitulo;
+    mostrandoNivel          = s.mostrandoNivel;
+    mostrandoTitulo         = s.mostrandoTitulo;
+    picoItems               = (size_t)s.picoItems;
+    itemsLiberados          = s.itemsLiberados;
+    itemsDescartados        = s.itemsDescartados;
+    celdasTocadas           = s.celdasTocadas;
+    reglasEvaluadas         = s.reglasEvaluadas;
+
+    // la rejilla es la que prepararRejilla() haría con estas medidas
+    const int tc = (int)cfg.tamanoCelda;
+    if (!medidasValidas(ancho, alto)
+     || columnas != (ancho + tc - 1) / tc + 1 || filas != alto / tc
+     || palabrasColumna != (filas + 63) / 64 || filasPlano != 64 * palabrasColumna
+     || columnaInicial < 0 || columnaInicial >= columnas) return false;
+    // tras reciclar columnas origenX queda en (-tamanoCelda, 0]
+    if (!(origenX > -cfg.tamanoCelda && origenX <= 0)
+     || !valorCampoValido("velocidadDesplazamiento", velocidadDesplazamiento)) return false;
+
+    const int totalColores = (int)coloresHex.size();
+    if ((int)paleta.size() != totalColores || indiceCicloColor < 0 || indiceCicloColor >= totalColores)
+        return false;
+    for (int color : paleta)
+        if (color < 0 || color >= totalColores) return false;
+
+    const size_t totalPalabras = (size_t)columnas * palabrasColumna;
+    const size_t totalCeldas   = (size_t)columnas * filasPlano;
+    for (auto* plano : {&vivas, &zonaSinGeneracion})
+        if (!l.leerVector(*plano) || plano->size() != totalPalabras) return false;
+    // las filas de relleno (de filas a filasPlano) tienen que estar a cero:
+    // desplazarColumnas y la regla de vida las leen como vecinas de la última
+    if (filas % 64) {
+        const uint64_t relleno = ~0ull << (filas % 64);
+        for (auto* plano : {&vivas, &zonaSinGeneracion})
+            for (int x = 0; x < columnas; ++x)
+                if ((*plano)[(size_t)(x + 1) * palabrasColumna - 1] & relleno) return false;
+    }
+    for (auto* plano : {&pasoTamano, &fotogramaDebido, &periodo, &indiceColor, &enAnimacion})
+        if (!l.leerVector(*plano) || plano->size() != totalCeldas) return false;
+    for (size_t i = 0; i < totalCeldas; ++i)
+        if (pasoTamano[i] > pasosTamano || indiceColor[i] >= totalColores
+         || periodo[i] >= tamanoRueda || enAnimacion[i] > 1) return false;
+    for (auto* plano : {&cambiadas, &norte, &sur, &siguientes}) plano->assign(totalPalabras, 0);
+    columnaDebida.assign(columnas, 0);
+    columnaDesplazar.assign(columnas, 0);
+
+    // cada entrada de una lista es una celda de la propia tesela: actualizarTesela
+    // la usa de índice y escribe sus bits sin cerrojo. Las de la rueda además
+    // se reprograman periodo fotogramas más tarde, que no puede ser 0.
+    teselas.resize((size_t)(columnas + columnasTesela - 1) / columnasTesela * palabrasColumna);
+    auto deLaTesela = [&](const vector<uint32_t>& lista, const Tesela& te, bool enRueda) {
+        for (uint32_t i : lista)
+            if (i >= totalCeldas || &teselaCelda(i) != &te || (enRueda && periodo[i] < 1)) return false;
+        return true;
+    };
+    for (Tesela& te : teselas) {
+        TeselaCaptura f;
+        if (!l.leer(&f, sizeof(f)) || !l.leer(&te.rng, sizeof(te.rng)) || f.saltoEspontaneo < 0) return false;
+        te.saltoEspontaneo = f.saltoEspontaneo;
+        te.celdasTocadas   = f.celdasTocadas;
+        te.reglasEvaluadas = f.reglasEvaluadas;
+        te.distEspontanea  = geometric_distribution<long>(min(1.0, max(cfg.tasaEspontanea, 1e-12)));
+        for (int k = 0; k < tamanoRueda; ++k) {
+            if ((uint64_t)f.longitudRueda[k] * sizeof(uint32_t) > (uint64_t)(l.fin - l.p)) return false;
+            te.rueda[k].resize(f.longitudRueda[k]);
+            if (!l.leer(te.rueda[k].data(), te.rueda[k].size() * sizeof(uint32_t))
+             || !deLaTesela(te.rueda[k], te, true)) return false;
+        }
+        if ((uint64_t)f.longitudAnimando * sizeof(uint32_t) > (uint64_t)(l.fin - l.p)) return false;
+        te.animando.resize(f.longitudAnimando);
+        if (!l.leer(te.animando.data(), te.animando.size() * sizeof(uint32_t))
+         || !deLaTesela(te.animando, te, false)) return false;
+    }
+
+    if (!l.leerVector(items) || !l.leer(&jugador, sizeof(jugador))
+     || items.size() > (size_t)cfg.capacidadItems) return false;
+    // las colisiones y el reciclado convierten posiciones en índices de celda
+    auto finito = [](Point2f p) { return isfinite(p.x) && isfinite(p.y); };
+    for (const Recuperable& it : items)
+        if (!finito(it.pos) || !finito(it.vel) || !finito(it.posAnterior) || !(it.radio >= 0)) return false;
+    if (!finito(jugador.pos) || !finito(jugador.vel) || !finito(jugador.posAnterior)
+     || !(jugador.radio >= 0)) return false;
+    items.reserve(cfg.capacidadItems);
+    liberarItem.clear();
+    return true;
+}
+
+// Escribe en un fichero temporal y lo renombra: quien lea el fichero ve la
+// captura anterior o la nueva entera, nunca una a medias
+static bool escribirCaptura(const string& fichero, const vector<char>& bytes) {
+    const string temporal = fichero + ".tmp";
+    const int fd = open(temporal.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    size_t escritos = 0;
+    while (escritos < bytes.size()) {
+        const ssize_t r = write(fd, bytes.data() + escritos, bytes.size() - escritos);
+        if (r <= 0) break;
+        escritos += (size_t)r;
+    }
+    const bool ok = close(fd) == 0 && escritos == bytes.size();
+    return ok && rename(temporal.c_str(), fichero.c_str()) == 0;
+}
+
+// Proyecta el fichero y restaura desde la proyección; us, si no es nulo,
+// recibe lo que tardó todo (abrir, proyectar, copiar, cerrar)
+static bool cargarCaptura(Mundo& m, const string& fichero, double* us = nullptr) {
+    Reloj::time_point t0 = Reloj::now();
+    const int fd = open(fichero.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "No se puede abrir " << fichero << "\n";
+        return false;
+    }
+    struct stat st;
+    void* proyeccion = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(CabeceraCaptura))
+        proyeccion = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (proyeccion == MAP_FAILED) {
+        cerr << fichero << " no es una captura\n";
+        return false;
+    }
+    const bool ok = m.restaurar((const char*)proyeccion, (size_t)st.st_size);
+    munmap(proyeccion, (size_t)st.st_size);
+    if (us) *us = chrono::duration<double, micro>(Reloj::now() - t0).count();
+    if (!ok) cerr << fichero << ": captura de otra versión o dañada\n";
+    return ok;
+}
+
+// Capturas periódicas (cada cadaPasos pasos; 0 = sólo las pedidas) sin
+// parar al hilo que da los pasos: ése sólo copia el estado a un búfer, y
+// otro hilo escribe el fichero. Si la escritura anterior no ha terminado la
+// captura se salta en vez de esperar. El hilo escritor se crea con la
+// primera captura: sin --captura-cada ni F5 no hay ninguno.
+struct PuntosControl {
+    PuntosControl(const string& fichero, long cadaPasos);
+    ~PuntosControl();   // espera a la escritura en curso
+
+    const string fichero;
+    void pasoDado(const Mundo& m);   // tras cada paso
+    bool guardar(const Mundo& m);    // ahora; false si había otra en curso
+
+    // Sólo las escribe el hilo que da los pasos
+    long   guardadas = 0, saltadas = 0;
+    double usCopia = 0, usCopiaMaximo = 0;   // acumulado y máximo
+    size_t bytes = 0;                        // de la última
+    atomic<long> fallidas{0};
+
+private:
+    long               cadaPasos;
+    long               pasos = 0;
+    vector<char>       propio, pendiente;   // del hilo de pasos y en espera de escribirse
+    mutex              m;
+    condition_variable hayPendiente;
+    bool               ocupado = false;     // hay una captura pendiente o escribiéndose
+    bool               salir   = false;
+    thread             escritor;            // desde la primera captura
+
+    void bucle();
+};
+
+PuntosControl::PuntosControl(const string& f, long cada) : fichero(f), cadaPasos(cada) {}
+
+PuntosControl::~PuntosControl() {
+    {
+        lock_guard<mutex> l(m);
+        salir = true;
+    }
+    hayPendiente.notify_one();
+    if (escritor.joinable()) escritor.join();
+}
+
+void PuntosControl::pasoDado(const Mundo& mundo) {
+    if (cadaPasos > 0 && ++pasos % cadaPasos == 0 && !guardar(mundo)) saltadas++;
+}
+
+bool PuntosControl::guardar(const Mundo& mundo) {
+    {
+        lock_guard<mutex> l(m);
+        if (ocupado) return false;
+    }
+    Reloj::time_point t0 = Reloj::now();
+    mundo.capturar(propio);
+    const double us = chrono::duration<double, micro>(Reloj::now() - t0).count();
+    usCopia      += us;
+    usCopiaMaximo = max(usCopiaMaximo, us);
+    bytes         = propio.size();
+    guardadas++;
+    {
+        lock_guard<mutex> l(m);
+        swap(propio, pendiente);
+        ocupado = true;
+    }
+    if (!escritor.joinable()) escritor = thread([this] { bucle(); });
+    hayPendiente.notify_one();
+    return true;
+}
+
+void PuntosControl::bucle() {
+    vector<char> escribiendo;
+    unique_lock<mutex> l(m);
+    for (;;) {
+        hayPendiente.wait(l, [this] { return salir || ocupado; });
+        if (!ocupado) return;
+        swap(pendiente, escribiendo);
+        l.unlock();
+        if (!escribirCaptura(fichero, escribiendo)) {
+            cerr << "No se puede escribir " << fichero << "\n";
+            fallidas++;
+        }
+        l.lock();
+        ocupado = false;
+    }
+}
+
+// Peticiones de la ventana (F5 y F9) al hilo de simulación
+enum { CAPTURA_GUARDAR = 1, CAPTURA_RESTAURAR = 2 };
+
+static void imprimirPuntosControl(const PuntosControl& p, ostream& os) {
+    if (p.guardadas == 0 && p.saltadas == 0) return;
+    os << fixed << setprecision(1)
+       << "capturas en " << p.fichero << ": " << p.guardadas << " guardadas ("
+       << p.bytes / 1024.0 << " KiB), " << p.saltadas << " saltadas, " << p.fallidas
+       << " fallidas; copia " << p.usCopia / max(p.guardadas, 1L) << " µs de media, "
+       << p.usCopiaMaximo << " µs como máximo\n";
+}
+
+// ======== Modo sin ventana ========
+
+// Entrada guionada: mantiene al jugador cerca del centro y salta en cuanto
+// toca suelo. Sólo depende del estado del mundo, así que es determinista.
+static Entrada entradaGuionada(const Mundo& m) {
+    Entrada e;
+    e.derecha   = m.jugador.pos.x < m.ancho * 0.4f;
+    e.izquierda = m.jugador.pos.x > m.ancho * 0.6f;
+    e.salto     = m.jugador.enSuelo;
+    return e;
+}
+
+struct ResultadoSimulacion {
+    long   fotogramas = 0;
+    int    partidas   = 0;     // reinicios por derrota incluidos
+    double segundos   = 0;
+    double nsFase[NUM_FASES] = {};
+    long   celdas     = 0;     // tamaño de la rejilla
+    double celdasTocadas = 0;  // media por fotograma
+    long   columnas   = 0;
+    double columnasNucleo = 0; // media por fotograma de columnas que recorre el núcleo de vida
+    long   fotogramasDistintos = -1;   // con comprobarDibujo: difieren del dibujo completo
+    double bytesDibujo = 0;    // media por fotograma escrita por el dibujo incremental
+    double bytesCompleto = 0, nsCompleto = 0;   // con comprobarDibujo: lo mismo del completo
+    size_t itemsVivos = 0, picoItems = 0;
+    long   itemsLiberados = 0, itemsDescartados = 0;
+    uint64_t huella   = 0;     // del estado final (Mundo::huella)
+};
+
+// Avanza el mundo tan rápido como sea posible, sin SDL ni esperas
+// Con comprobarDibujo cada fotograma se dibuja también de forma completa y
+// se compara con el incremental; ese dibujo y la comparación no cuentan en
+// los segundos del resultado. Con perfil cada fotograma es una tanda de
+// un paso. Con puntos se guardan capturas periódicas.
+static ResultadoSimulacion simularSinVentana(Mundo& mundo, long fotogramas, bool dibujar,
+                                             bool comprobarDibujo = false, Perfil* perfil = nullptr,
+                                             PuntosControl* puntos = nullptr, bool capaIndexada = true) {
+    ResultadoSimulacion r;
+    Mat fotograma(mundo.alto, mundo.ancho, CV_8UC3), referencia;
+    DibujoIncremental dibujo;
+    dibujo.indexada = capaIndexada;
+    if (comprobarDibujo) r.fotogramasDistintos = 0;
+    mundo.medirFases = true;
+    fill(begin(mundo.nsFase), end(mundo.nsFase), 0.0);
+    mundo.celdasTocadas  = 0;
+    mundo.columnasNucleo = 0;
+    r.partidas = 1;
+    r.celdas   = (long)mundo.columnas * mundo.filas;
+    r.columnas = mundo.columnas;
+
+    Reloj::time_point inicio = Reloj::now();
+    double            nsComprobar = 0;
+    double            nsAntes[NUM_FASES_MUNDO], nsTanda[NUM_FASES_MUNDO];
+    long              reglasAntes = 0;
+    Reloj::time_point inicioPaso;
+    for (long i = 0; i < fotogramas; ++i) {
+        if (perfil) {
+            copy(mundo.nsFase, mundo.nsFase + NUM_FASES_MUNDO, nsAntes);
+            reglasAntes = mundo.reglasEvaluadas;
+            inicioPaso  = Reloj::now();
+        }
+        bool sigue = mundo.paso(entradaGuionada(mundo));
+        if (dibujar) {
+            Reloj::time_point t0 = Reloj::now();
+            dibujo.dibujar(mundo, fotograma);
+            mundo.nsFase[FASE_DIBUJO] += chrono::duration<double, nano>(Reloj::now() - t0).count();
+            if (comprobarDibujo) {
+                Reloj::time_point t1 = Reloj::now();
+                referencia.create(fotograma.rows, fotograma.cols, fotograma.type());
+                const long celdasPix = mundo.dibujarCeldas(referencia);   // como Mundo::dibujar
+                mundo.dibujarDinamico(referencia);
+                Reloj::time_point t2 = Reloj::now();
+                r.nsCompleto    += chrono::duration<double, nano>(t2 - t1).count();
+                r.bytesCompleto += (double)(referencia.total() + celdasPix) * 3;
+                for (int y = 0; y < fotograma.rows; ++y)
+                    if (memcmp(fotograma.ptr<uchar>(y), referencia.ptr<uchar>(y),
+                               (size_t)fotograma.cols * fotograma.elemSize()) != 0) {
+                        r.fotogramasDistintos++;
+                        break;
+                    }
+                nsComprobar += chrono::duration<double, nano>(Reloj::now() - t1).count();
+            }
+        }
+        if (perfil) {
+            for (int f = 0; f < NUM_FASES_MUNDO; ++f) nsTanda[f] = mundo.nsFase[f] - nsAntes[f];
+            perfil->anotarTanda(nsTanda, inicioPaso, 1, mundo.celdasVivas(), (long)mundo.items.size(),
+                                mundo.reglasEvaluadas - reglasAntes);
+            perfil->cerrarFotograma();
+        }
+        if (!sigue) {
+            mundo.reiniciar();
+            r.partidas++;
+        }
+        if (puntos) puntos->pasoDado(mundo);
+    }
+    r.segundos   = chrono::duration<double>(Reloj::now() - inicio).count() - nsComprobar * 1e-9;
+    r.fotogramas = fotogramas;
+    r.bytesDibujo   = dibujo.bytesEscritos / max(fotogramas, 1L);
+    r.bytesCompleto /= max(fotogramas, 1L);
+    r.nsCompleto    /= max(fotogramas, 1L);
+    copy(begin(mundo.nsFase), end(mundo.nsFase), r.nsFase);
+    r.celdasTocadas = mundo.celdasTocadas / (double)max(fotogramas, 1L);
+    r.columnasNucleo = mundo.columnasNucleo / (double)max(fotogramas, 1L);
+    r.itemsVivos       = mundo.items.size();
+    r.picoItems        = mundo.picoItems;
+    r.itemsLiberados   = mundo.itemsLiberados;
+    r.itemsDescartados = mundo.itemsDescartados;
+    r.huella           = mundo.huella();
+    return r;
+}
+
+static void imprimirResultado(const ResultadoSimulacion& r) {
+    cout << fixed << setprecision(1)
+         << r.fotogramas << " fotogramas en " << r.segundos << " s ("
+         << r.fotogramas / max(r.segundos, 1e-9) << " fotogramas/s, "
+         << r.partidas << " partidas)\n"
+         << "  " << r.celdasTocadas << " de " << r.celdas << " celdas tocadas por fotograma\n"
+         << "  núcleo de vida en " << r.columnasNucleo << " de " << r.columnas << " columnas por fotograma\n"
+         << "  ítems: " << r.itemsVivos << " vivos, pico " << r.picoItems
+         << ", " << r.itemsLiberados << " liberados, " << r.itemsDescartados << " descartados\n";
+    if (r.bytesDibujo > 0)
+        cout << "  dibujo incremental: " << r.bytesDibujo / 1e6 << " MB escritos por fotograma\n";
+    if (r.fotogramasDistintos >= 0)
+        cout << "  " << r.fotogramasDistintos << " fotogramas distintos del dibujo completo\n"
+             << "  dibujo completo: " << r.bytesCompleto / 1e6 << " MB escritos y "
+             << r.nsCompleto << " ns por fotograma\n";
+    cout << "  huella final: " << hex << r.huella << dec << "\n";
+    for (int f = 0; f < NUM_FASES_MUNDO; ++f)
+        cout << "  " << setw(10) << nombresFase[f] << ": "
+             << setw(12) << r.nsFase[f] / max(r.fotogramas, 1L) << " ns/fotograma\n";
+}
+
+// Recorre varios tamaños de celda y velocidades de desplazamiento con
+// semilla fija, para que las regresiones del bucle principal se vean en cifras.
+// Cada fotograma se dibuja también completo para comparar bytes escritos y
+// tiempo con el incremental (ns_dibujo incluye ítems, jugador y textos, como
+// ns_completo).
+static void ejecutarBenchmark(const ConfiguracionJuego& base, int ancho, int alto,
+                              unsigned semilla, long fotogramas, ReservaHilos* hilos) {
+    const double tamanos[]     = {120, 60, 32, 16, 8, 4};
+    const double velocidades[] = {10, 100, 400};
+
+    cout << "celda,desplazamiento,hilos,fotogramas_s,celdas,celdas_tocadas,columnas,columnas_nucleo,items_pico"
+         << ",bytes_dibujo,bytes_completo,ns_completo";
+    for (int f = 0; f < NUM_FASES_MUNDO; ++f) cout << ",ns_" << nombresFase[f];
+    cout << "\n";
+    for (double tam : tamanos) {
+        for (double vel : velocidades) {
+            ConfiguracionJuego cfg = base;
+            cfg.tamanoCelda             = tam;
+            cfg.velocidadDesplazamiento = vel;
+            Mundo mundo(cfg, ancho, alto, semilla);
+            mundo.hilos = hilos;
+            ResultadoSimulacion r = simularSinVentana(mundo, fotogramas, true, true);
+            cout << fixed << setprecision(1)
+                 << tam << "," << vel << "," << mundo.numHilos() << ","
+                 << r.fotogramas / max(r.segundos, 1e-9)
+                 << "," << r.celdas << "," << r.celdasTocadas << "," << r.columnas
+                 << "," << r.columnasNucleo << "," << r.picoItems
+                 << "," << r.bytesDibujo << "," << r.bytesCompleto << "," << r.nsCompleto;
+            for (int f = 0; f < NUM_FASES_MUNDO; ++f)
+                cout << "," << r.nsFase[f] / max(r.fotogramas, 1L);
+            cout << endl;
+        }
+    }
+}
+
+// Fase de ítems con la reserva llena de miles de ítems, con y sin fase
+// amplia. Los ítems se siembran al azar (semilla fija) sobre la pantalla y se
+// miden los pasos siguientes, mientras caen y se posan; items_medios es la
+// media de vivos por paso en ese tramo. La columna igual indica si el estado
+// final coincide con fase amplia y sin ella, como debe.
+static void ejecutarBenchmarkItems(const ConfiguracionJuego& base, int ancho, int alto,
+                                   unsigned semilla, long pasos, ReservaHilos* hilos) {
+    const double tamanos[] = {120, 32};
+    const int    cuentas[] = {1000, 4000, 16000, 64000};
+
+    cout << "celda,items_sembrados,fase_amplia,items_medios,ns_items,ns_por_item,igual\n";
+    for (double tam : tamanos) {
+        for (int n : cuentas) {
+            uint64_t huellaAmplia = 0;
+            for (int amplia = 1; amplia >= 0; --amplia) {
+                ConfiguracionJuego cfg = base;
+                cfg.tamanoCelda    = tam;
+                cfg.capacidadItems = max(cfg.capacidadItems, n);
+                Mundo mundo(cfg, ancho, alto, semilla);
+                mundo.hilos      = hilos;
+                mundo.faseAmplia = amplia;
+                mt19937 g(semilla);
+                uniform_real_distribution<float> px(0, (float)ancho), py(0, alto * 0.9f);
+                while ((int)mundo.items.size() < n) {
+                    Recuperable itm;
+                    itm.pos   = itm.posAnterior = Point2f(px(g), py(g));
+                    itm.vel   = Point2f(0, 0);
+                    itm.radio = cfg.radioItem;
+                    mundo.items.push_back(itm);
+                }
+                mundo.medirFases = true;
+                double vivos = 0;
+                long   dados = 0;
+                while (dados < pasos) {
+                    vivos += mundo.items.size();
+                    dados++;
+                    if (!mundo.paso(entradaGuionada(mundo))) break;
+                }
+                if (amplia) huellaAmplia = mundo.huella();
+                const double nsItems = mundo.nsFase[FASE_ITEMS] / dados;
+                vivos /= dados;
+                cout << fixed << setprecision(1)
+                     << tam << "," << n << "," << (amplia ? "si" : "no") << "," << vivos << ","
+                     << nsItems << "," << nsItems / max(vivos, 1.0) << ","
+                     << (mundo.huella() == huellaAmplia ? "si" : "no") << endl;
+            }
+        }
+    }
+}
+
+// Mismo caso con 1, 2, 4 ... hasta maxHilos hilos. La columna igual indica
+// si el estado final coincide con el de un hilo: el reparto por teselas no
+// depende del número de hilos, así que debe coincidir siempre.
+static void ejecutarEscalado(const ConfiguracionJuego& cfg, int ancho, int alto,
+                             unsigned semilla, long fotogramas, int maxHilos) {
+    vector<int> cuentas;
+    for (int n = 1; n < maxHilos; n *= 2) cuentas.push_back(n);
+    cuentas.push_back(maxHilos);
+
+    cout << "celda,hilos,fotogramas_s,aceleracion,igual";
+    for (int f = 0; f < NUM_FASES_MUNDO; ++f) cout << ",ns_" << nombresFase[f];
+    cout << "\n";
+    double   base = 0;
+    uint64_t huellaBase = 0;
+    for (int n : cuentas) {
+        ReservaHilos hilos(n);
+        Mundo mundo(cfg, ancho, alto, semilla);
+        mundo.hilos = &hilos;
+        ResultadoSimulacion r = simularSinVentana(mundo, fotogramas, true);
+        const double fps = r.fotogramas / max(r.segundos, 1e-9);
+        if (n == 1) {
+            base       = fps;
+            huellaBase = r.huella;
+        }
+        cout << fixed << setprecision(1)
+             << cfg.tamanoCelda << "," << n << "," << fps << ","
+             << setprecision(2) << fps / base << "," << (r.huella == huellaBase ? "si" : "no")
+             << setprecision(1);
+        for (int f = 0; f < NUM_FASES_MUNDO; ++f)
+            cout << "," << r.nsFase[f] / max(r.fotogramas, 1L);
+        cout << endl;
+    }
+}
+
+// ======== Grabación y reproducción ========
+// Una partida queda determinada por la semilla, la configuración, el tamaño
+// del mundo y las teclas de cada paso, así que basta guardar eso para
+// repetirla exactamente. Formato, con enteros en little endian:
+//   cabecera: "AUTOGRAB", versión u32, semilla u32, ancho i32, alto i32,
+//             intervaloHuella u32 y los campos de ConfiguracionJuego
+//   registros, cada uno con un byte de tipo:
+//     0..7  tramo: esas teclas (Entrada::bits) durante n pasos, n varint
+//     0x80  tamaño: paso varint, ancho i32, alto i32, aplicado antes del paso
+//     0x81  huella: paso varint, Mundo::huella() u64 tras el paso
+//     0xFF  fin
+// Los tramos se escriben al cambiar las teclas, así que el fichero crece con
+// las pulsaciones y con las huellas, no con cada paso. Sin el registro de fin
+// (el programa no terminó bien) se reproduce hasta el último tramo completo.
+
+static const char marcaGrabacion[8] = {'A', 'U', 'T', 'O', 'G', 'R', 'A', 'B'};
+static constexpr uint32_t versionGrabacion = 3;   // 2: el cambio de tamaño rehace la rejilla al momento
+                                                  // 3: nacimientos espontáneos sorteados por tesela
+enum : uint8_t { REGISTRO_TAMANO = 0x80, REGISTRO_HUELLA = 0x81, REGISTRO_FIN = 0xFF };
+
+static void escribirLE(ostream& os, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) os.put((char)(v >> (8 * i)));
+}
+
+static bool leerLE(istream& is, uint64_t& v, int bytes) {
+    v = 0;
+    for (int i = 0; i < bytes; ++i) {
+        const int c = is.get();
+        if (c == EOF) return false;
+        v |= (uint64_t)c << (8 * i);
+    }
+    return true;
+}
+
+static void escribirVarint(ostream& os, uint64_t v) {
+    for (; v >= 0x80; v >>= 7) os.put((char)(v | 0x80));
+    os.put((char)v);
+}
+
+static bool leerVarint(istream& is, uint64_t& v) {
+    v = 0;
+    for (int desplazamiento = 0; desplazamiento < 64; desplazamiento += 7) {
+        const int c = is.get();
+        if (c == EOF) return false;
+        v |= (uint64_t)(c & 0x7F) << desplazamiento;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+static void escribirCampo(ostream& os, double v)   { uint64_t b; memcpy(&b, &v, 8); escribirLE(os, b, 8); }
+static void escribirCampo(ostream& os, float v)    { uint32_t b; memcpy(&b, &v, 4); escribirLE(os, b, 4); }
+static void escribirCampo(ostream& os, int v)      { escribirLE(os, (uint32_t)v, 4); }
+static void escribirCampo(ostream& os, unsigned v) { escribirLE(os, v, 4); }
+
+static bool leerCampo(istream& is, double& v) {
+    uint64_t b;
+    if (!leerLE(is, b, 8)) return false;
+    memcpy(&v, &b, 8);
+    return true;
+}
+static bool leerCampo(istream& is, float& v) {
+    uint64_t b;
+    if (!leerLE(is, b, 4)) return false;
+    const uint32_t b32 = (uint32_t)b;
+    memcpy(&v, &b32, 4);
+    return true;
+}
+static bool leerCampo(istream& is, int& v) {
+    uint64_t b;
+    if (!leerLE(is, b, 4)) return false;
+    v = (int)(uint32_t)b;
+    return true;
+}
+static bool leerCampo(istream& is, unsigned& v) {
+    uint64_t b;
+    if (!leerLE(is, b, 4)) return false;
+    v = (unsigned)b;
+    return true;
+}
+
+struct CabeceraGrabacion {
+    unsigned           semilla = 0;
+    int                ancho = 0, alto = 0;
+    unsigned           intervaloHuella = 1;   // pasos entre huellas; 0 = ninguna
+    ConfiguracionJuego cfg;
+};
+
+// La escribe el hilo que da los pasos
+struct Grabacion {
+    bool abrir(const string& fichero, const CabeceraGrabacion& c);
+    void cambioTamano(int ancho, int alto);            // antes del próximo paso
+    void pasoDado(uint8_t teclas, const Mundo& m);     // tras el paso (y el reinicio)
+    void cerrar();
+    long pasos() const { return numPasos; }
+
+private:
+    ofstream salida;
+    unsigned intervaloHuella = 1;
+    long     numPasos        = 0;
+    uint8_t  teclasTramo     = 0;
+    uint64_t longitudTramo   = 0;
+
+    void cerrarTramo();
+};
+
+bool Grabacion::abrir(const string& fichero, const CabeceraGrabacion& c) {
+    salida.open(fichero, ios::binary);
+    if (!salida) {
+        cerr << "No se puede escribir " << fichero << endl;
+        return false;
+    }
+    intervaloHuella = c.intervaloHuella;
+    salida.write(marcaGrabacion, sizeof(marcaGrabacion));
+    escribirCampo(salida, (unsigned)versionGrabacion);
+    escribirCampo(salida, c.semilla);
+    escribirCampo(salida, c.ancho);
+    escribirCampo(salida, c.alto);
+    escribirCampo(salida, c.intervaloHuella);
+    camposConfiguracion(c.cfg, [&](const char*, auto v) { escribirCampo(salida, v); });
+    return true;
+}
+
+void Grabacion::cerrarTramo() {
+    if (longitudTramo == 0) return;
+    salida.put((char)teclasTramo);
+    escribirVarint(salida, longitudTramo);
+    longitudTramo = 0;
+}
+
+void Grabacion::cambioTamano(int ancho, int alto) {
+    salida.put((char)REGISTRO_TAMANO);
+    escribirVarint(salida, numPasos);
+    escribirCampo(salida, ancho);
+    escribirCampo(salida, alto);
+}
+
+void Grabacion::pasoDado(uint8_t teclas, const Mundo& m) {
+    if (longitudTramo > 0 && teclas != teclasTramo) cerrarTramo();
+    teclasTramo = teclas;
+    longitudTramo++;
+    if (intervaloHuella && numPasos % intervaloHuella == 0) {
+        salida.put((char)REGISTRO_HUELLA);
+        escribirVarint(salida, numPasos);
+        escribirLE(salida, m.huella(), 8);
+    }
+    numPasos++;
+    // una vez por segundo de juego, para no perder más si el programa cae
+    if (numPasos % Mundo::fps == 0) salida.flush();
+}
+
+void Grabacion::cerrar() {
+    if (!salida.is_open()) return;
+    cerrarTramo();
+    salida.put((char)REGISTRO_FIN);
+    salida.close();
+}
+
+// Grabación cargada entera en memoria, que se consume paso a paso
+struct Reproduccion {
+    CabeceraGrabacion cabecera;
+    long comprobadas = 0, distintas = 0;   // huellas
+    long primeraDistinta = -1;             // paso
+
+    bool    cargar(const string& fichero);
+    long    totalPasos() const { return numPasos; }
+    bool    terminada() const  { return paso >= numPasos; }
+    uint8_t antesDelPaso(Mundo& m);        // aplica cambios de tamaño y da las teclas
+    void    despuesDelPaso(const Mundo& m);   // comprueba la huella, si la hay
+
+private:
+    struct Tramo        { uint8_t teclas; uint64_t longitud; };
+    struct CambioTamano { long paso; int ancho, alto; };
+    struct Huella       { long paso; uint64_t valor; };
+
+    vector<Tramo>        tramos;
+    vector<CambioTamano> tamanos;
+    vector<Huella>       huellas;
+    long     numPasos = 0, paso = 0;
+    size_t   tramo = 0, siguienteTamano = 0, siguienteHuella = 0;
+    uint64_t usadoTramo = 0;
+};
+
+bool Reproduccion::cargar(const string& fichero) {
+    ifstream entrada(fichero, ios::binary);
+    char     marca[sizeof(marcaGrabacion)];
+    unsigned version = 0;
+    if (!entrada.read(marca, sizeof(marca)) || memcmp(marca, marcaGrabacion, sizeof(marca)) != 0
+     || !leerCampo(entrada, version)) {
+        cerr << fichero << " no es una grabación" << endl;
+        return false;
+    }
+    if (version != versionGrabacion) {
+        cerr << fichero << ": versión " << version << " de grabación no admitida" << endl;
+        return false;
+    }
+    bool ok = leerCampo(entrada, cabecera.semilla) && leerCampo(entrada, cabecera.ancho)
+           && leerCampo(entrada, cabecera.alto) && leerCampo(entrada, cabecera.intervaloHuella);
+    camposConfiguracion(cabecera.cfg, [&](const char*, auto& v) { ok = ok && leerCampo(entrada, v); });
+    if (!ok) {
+        cerr << fichero << ": cabecera incompleta" << endl;
+        return false;
+    }
+    // antes de construir ningún Mundo: un lado de celda 0 o un tamaño
+    // negativo no se detectan después
+    if (!configuracionValida(cabecera.cfg) || !medidasValidas(cabecera.ancho, cabecera.alto)) {
+        cerr << fichero << ": cabecera con valores fuera de rango" << endl;
+        return false;
+    }
+
+    bool completa = false;
+    for (int tipo; !completa && (tipo = entrada.get()) != EOF;) {
+        uint64_t paso = 0, valor = 0;
+        if (tipo < 8) {
+            if (!leerVarint(entrada, valor)) break;
+            // antesDelPaso sólo cambia de tramo al agotarlo
+            if (valor == 0) {
+                cerr << fichero << ": tramo de teclas vacío" << endl;
+                return false;
+            }
+            tramos.push_back({(uint8_t)tipo, valor});
+            numPasos += (long)valor;
+        } else if (tipo == REGISTRO_TAMANO) {
+            CambioTamano c;
+            if (!leerVarint(entrada, paso) || !leerCampo(entrada, c.ancho) || !leerCampo(entrada, c.alto)) break;
+            if (!medidasValidas(c.ancho, c.alto)) {
+                cerr << fichero << ": cambio de tamaño a " << c.ancho << "x" << c.alto << " fuera de rango" << endl;
+                return false;
+            }
+            c.paso = (long)paso;
+            tamanos.push_back(c);
+        } else if (tipo == REGISTRO_HUELLA) {
+            if (!leerVarint(entrada, paso) || !leerLE(entrada, valor, 8)) break;
+            huellas.push_back({(long)paso, valor});
+        } else if (tipo == REGISTRO_FIN) {
+            completa = true;
+        } else {
+            cerr << fichero << ": registro desconocido " << tipo << endl;
+            return false;
+        }
+    }
+    if (!completa) cerr << fichero << ": grabación incompleta, se reproducen " << numPasos << " pasos\n";
+    return true;
+}
+
+uint8_t Reproduccion::antesDelPaso(Mundo& m) {
+    for (; siguienteTamano < tamanos.size() && tamanos[siguienteTamano].paso <= paso; ++siguienteTamano)
+        m.redimensionar(tamanos[siguienteTamano].ancho, tamanos[siguienteTamano].alto);
+    const uint8_t teclas = tramos[tramo].teclas;
+    if (++usadoTramo == tramos[tramo].longitud) {
+        tramo++;
+        usadoTramo = 0;
+    }
+    return teclas;
+}
+
+void Reproduccion::despuesDelPaso(const Mundo& m) {
+    for (; siguienteHuella < huellas.size() && huellas[siguienteHuella].paso <= paso; ++siguienteHuella) {
+        if (huellas[siguienteHuella].paso != paso) continue;
+        comprobadas++;
+        if (m.huella() != huellas[siguienteHuella].valor) {
+            if (distintas++ == 0) primeraDistinta = paso;
+        }
+    }
+    paso++;
+}
+
+static void imprimirReproduccion(const Reproduccion& r) {
+    cout << "  huellas: " << r.comprobadas << " comprobadas, " << r.distintas << " distintas";
+    if (r.distintas) cout << " (la primera tras el paso " << r.primeraDistinta << ")";
+    cout << "\n";
+}
+
+// Reproduce sin ventana ni esperas; devuelve false si alguna huella difiere
+static bool reproducirSinVentana(Reproduccion& r, ReservaHilos* hilos) {
+    const CabeceraGrabacion& c = r.cabecera;
+    Mundo mundo(c.cfg, c.ancho, c.alto, c.semilla);
+    mundo.hilos = hilos;
+    int partidas = 1;
+    Reloj::time_point inicio = Reloj::now();
+    while (!r.terminada()) {
+        const Entrada entrada = Entrada::desdeBits(r.antesDelPaso(mundo));
+        if (!mundo.paso(entrada)) {
+            mundo.reiniciar();
+            partidas++;
+        }
+        r.despuesDelPaso(mundo);
+    }
+    const double segundos = chrono::duration<double>(Reloj::now() - inicio).count();
+    cout << fixed << setprecision(1)
+         << r.totalPasos() << " pasos en " << segundos << " s ("
+         << r.totalPasos() / max(segundos, 1e-9) << " pasos/s, "
+         << r.totalPasos() / (double)Mundo::fps << " s de partida, " << partidas << " partidas)\n";
+    imprimirReproduccion(r);
+    cout << "  huella final: " << hex << mundo.huella() << dec << "\n";
+    return r.distintas == 0;
+}
+
+// ======== Exportación de vídeo ========
+// Dibuja a paso fijo, sin esperas, y pasa cada fotograma a un hilo que lo
+// codifica con VideoWriter (o lo escribe en bruto por la salida estándar),
+// de modo que la codificación se solapa con la simulación y el dibujo. Los
+// fotogramas van en un número fijo de búferes que se reciclan.
+
+// Búferes entre productor y codificador: libres -> llenos, en orden -> libres.
+// Si el codificador no da abasto reservar() espera; eso es la contrapresión.
+struct ColaFotogramas {
+    explicit ColaFotogramas(int capacidad);
+    Mat* reservar();          // búfer libre para dibujar; espera si no hay
+    void entregar(Mat* m);    // listo para codificar
+    Mat* tomar();             // el siguiente lleno; nullptr tras cerrar() y vaciarse
+    void devolver(Mat* m);
+    void cerrar();
+
+    // Del productor; se leen cuando el codificador ha terminado
+    long   esperas = 0;       // reservas que encontraron la cola llena
+    double msEspera = 0;
+    size_t picoLlenos = 0;
+
+private:
+    vector<Mat>        bufs;
+    vector<Mat*>       libres;
+    deque<Mat*>        llenos;
+    mutex              m;
+    condition_variable hayLibre, hayLleno;
+    bool               cerrada = false;
+};
+
+ColaFotogramas::ColaFotogramas(int capacidad) : bufs(max(1, capacidad)) {
+    for (Mat& b : bufs) libres.push_back(&b);
+}
+
+Mat* ColaFotogramas::reservar() {
+    unique_lock<mutex> l(m);
+    if (libres.empty()) {
+        Reloj::time_point t0 = Reloj::now();
+        hayLibre.wait(l, [&] { return !libres.empty(); });
+        esperas++;
+        msEspera += chrono::duration<double, milli>(Reloj::now() - t0).count();
+    }
+    Mat* b = libres.back();
+    libres.pop_back();
+    return b;
+}
+
+void ColaFotogramas::entregar(Mat* b) {
+    lock_guard<mutex> l(m);
+    llenos.push_back(b);
+    picoLlenos = max(picoLlenos, llenos.size());
+    hayLleno.notify_one();
+}
+
+Mat* ColaFotogramas::tomar() {
+    unique_lock<mutex> l(m);
+    hayLleno.wait(l, [&] { return !llenos.empty() || cerrada; });
+    if (llenos.empty()) return nullptr;
+    Mat* b = llenos.front();
+    llenos.pop_front();
+    return b;
+}
+
+void ColaFotogramas::devolver(Mat* b) {
+    lock_guard<mutex> l(m);
+    libres.push_back(b);
+    hayLibre.notify_one();
+}
+
+void ColaFotogramas::cerrar() {
+    lock_guard<mutex> l(m);
+    cerrada = true;
+    hayLleno.notify_all();
+}
+
+struct OpcionesExportacion {
+    string fichero;           // "-" = BGR24 en bruto por la salida estándar
+    string codec = "mp4v";    // fourcc para VideoWriter
+    int    ancho = 0, alto = 0;
+    long   fotogramas = 0;
+    int    capacidadCola = 8;
+};
+
+// Exporta la partida guionada o, con reproduccion, la grabada. Con una
+// grabación el tamaño del mundo es el suyo y cada fotograma se escala al de
+// salida.
+static bool exportarVideo(const ConfiguracionJuego& cfg, unsigned semilla, const OpcionesExportacion& op,
+                          Reproduccion* reproduccion, ReservaHilos* hilos) {
+    const bool aTuberia = op.fichero == "-";
+    ostream&   informe  = aTuberia ? cerr : cout;
+    const Size tamano(op.ancho, op.alto);
+    VideoWriter escritor;
+    if (!aTuberia) {
+        const string& c = op.codec;
+        if (c.size() != 4) {
+            cerr << "El códec debe tener cuatro letras: " << c << endl;
+            return false;
+        }
+        if (!escritor.open(op.fichero, VideoWriter::fourcc(c[0], c[1], c[2], c[3]), Mundo::fps, tamano)) {
+            cerr << "VideoWriter no puede abrir " << op.fichero << " con " << c << endl;
+            return false;
+        }
+    }
+
+    ColaFotogramas    cola(op.capacidadCola);
+    atomic<bool>      fallo{false};
+    double            msCodificar = 0;
+    thread codificador([&] {
+        Mat escalado;
+        while (Mat* f = cola.tomar()) {
+            Reloj::time_point t0 = Reloj::now();
+            const Mat* salida = f;
+            if (f->size() != tamano) {
+                resize(*f, escalado, tamano, 0, 0, INTER_NEAREST);
+                salida = &escalado;
+            }
+            if (aTuberia) {
+                const size_t bytesFila = (size_t)salida->cols * salida->elemSize();
+                for (int y = 0; y < salida->rows && !fallo; ++y)
+                    if (fwrite(salida->ptr<uchar>(y), 1, bytesFila, stdout) != bytesFila) fallo = true;
+            } else {
+                // write no devuelve nada: si el códec o el disco fallan,
+                // algunos backends cierran el escritor
+                escritor.write(*salida);
+                if (!escritor.isOpened()) fallo = true;
+            }
+            msCodificar += chrono::duration<double, milli>(Reloj::now() - t0).count();
+            cola.devolver(f);
+        }
+    });
+
+    const CabeceraGrabacion* c = reproduccion ? &reproduccion->cabecera : nullptr;
+    Mundo mundo(c ? c->cfg : cfg, c ? c->ancho : op.ancho, c ? c->alto : op.alto, c ? c->semilla : semilla);
+    mundo.hilos = hilos;
+    DibujoIncremental dibujo;
+    long  hechos = 0;
+    Reloj::time_point inicio = Reloj::now();
+    for (; hechos < op.fotogramas && !fallo; ++hechos) {
+        Entrada entrada;
+        if (reproduccion) {
+            if (reproduccion->terminada()) break;
+            entrada = Entrada::desdeBits(reproduccion->antesDelPaso(mundo));
+        } else {
+            entrada = entradaGuionada(mundo);
+        }
+        if (!mundo.paso(entrada)) mundo.reiniciar();
+        if (reproduccion) reproduccion->despuesDelPaso(mundo);
+        Mat* f = cola.reservar();
+        dibujo.dibujar(mundo, *f);
+        cola.entregar(f);
+    }
+    cola.cerrar();
+    codificador.join();
+    if (!aTuberia) {
+        escritor.release();
+        // los demás sólo lo notan en el fichero: se queda vacío o sin crear
+        struct stat st;
+        if (hechos > 0 && (stat(op.fichero.c_str(), &st) != 0 || st.st_size == 0)) fallo = true;
+    } else if (fflush(stdout) != 0) {
+        fallo = true;
+    }
+    const double segundos = chrono::duration<double>(Reloj::now() - inicio).count();
+
+    informe << fixed << setprecision(1)
+            << hechos << " fotogramas de " << op.ancho << "x" << op.alto << " en " << segundos << " s ("
+            << hechos / max(segundos, 1e-9) << " fotogramas/s, "
+            << hechos / (double)Mundo::fps << " s de vídeo)\n"
+            << "  codificar: " << setprecision(2) << msCodificar / max(hechos, 1L) << " ms/fotograma\n"
+            << "  cola de " << op.capacidadCola << ": pico " << cola.picoLlenos << " llenos, "
+            << cola.esperas << " esperas del dibujo (" << setprecision(1) << cola.msEspera << " ms)\n";
+    if (reproduccion) {
+        // imprimirReproduccion escribe en cout, que con tubería lleva el vídeo
+        informe << "  huellas: " << reproduccion->comprobadas << " comprobadas, "
+                << reproduccion->distintas << " distintas\n";
+    }
+    if (fallo) cerr << "Error al escribir la salida" << endl;
+    return !fallo && (!reproduccion || reproduccion->distintas == 0);
+}
+
+// ======== Lotes de partidas ========
+// Miles de partidas sin ventana, cada una con su semilla y su configuración,
+// para ajustar los parámetros con cifras en vez de a mano. Cada Mundo es
+// independiente (su generador, sus planos) y corre en un solo hilo; el
+// paralelismo está entre partidas.
+
+// Reparto con robo de trabajo: cada trabajador tiene su cola de tareas,
+// saca del final de la suya y, cuando se le acaba, roba del principio de la
+// de otro. Las partidas duran muy distinto (una derrota temprana frente a
+// una que llega al límite), así que un reparto fijo dejaría hilos parados.
+// Las tareas son partidas enteras: un mutex por cola basta.
+struct RepartoConRobo {
+    explicit RepartoConRobo(int hilos);   // 0 = uno por núcleo
+
+    int  numHilos() const { return (int)colas.size(); }
+    // Llama a f(tarea, trabajador) para cada tarea de 0 a n-1 y vuelve
+    // cuando han terminado todas
+    void ejecutar(long n, const function<void(long, int)>& f);
+    long robos() const { return robadas; }
+
+private:
+    struct Cola {
+        mutex       m;
+        deque<long> tareas;
+    };
+    vector<unique_ptr<Cola>> colas;
+    atomic<long>             robadas{0};
+
+    bool tomar(int trabajador, long& tarea);
+};
+
+RepartoConRobo::RepartoConRobo(int hilos) {
+    if (hilos <= 0) hilos = (int)max(1u, thread::hardware_concurrency());
+    for (int i = 0; i < hilos; ++i) colas.push_back(make_unique<Cola>());
+}
+
+bool RepartoConRobo::tomar(int trabajador, long& tarea) {
+    {
+        Cola& propia = *colas[trabajador];
+        lock_guard<mutex> l(propia.m);
+        if (!propia.tareas.empty()) {
+            tarea = propia.tareas.back();
+            propia.tareas.pop_back();
+            return true;
+        }
+    }
+    // Nadie añade tareas mientras se ejecuta: si todas las colas están
+    // vacías, no queda nada que hacer
+    for (int k = 1; k < numHilos(); ++k) {
+        Cola& otra = *colas[(trabajador + k) % numHilos()];
+        lock_guard<mutex> l(otra.m);
+        if (!otra.tareas.empty()) {
+            tarea = otra.tareas.front();
+            otra.tareas.pop_front();
+            robadas++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void RepartoConRobo::ejecutar(long n, const function<void(long, int)>& f) {
+    // Tramos seguidos: las tareas vecinas (misma configuración) caen juntas
+    const int h = numHilos();
+    for (int w = 0; w < h; ++w)
+        for (long i = n * w / h; i < n * (w + 1) / h; ++i) colas[w]->tareas.push_back(i);
+    auto trabajar = [&](int w) {
+        for (long tarea; tomar(w, tarea);) f(tarea, w);
+    };
+    vector<thread> trabajadores;
+    for (int w = 1; w < h; ++w) trabajadores.emplace_back(trabajar, w);
+    trabajar(0);
+    for (auto& t : trabajadores) t.join();
+}
+
+// Quién juega las partidas del lote
+enum Agente { AGENTE_GUIONADO, AGENTE_HEURISTICO };
+static const char* nombresAgente[] = { "guionado", "heuristico" };
+
+// Agente heurístico: salta en cuanto toca suelo, como entradaGuionada, pero
+// en vez de quedarse en el centro va a por el ítem más cercano que esté por
+// encima de él, sin salir de la parte central de la pantalla, y se corre a la
+// columna más próxima que tenga alguna celda sólida debajo para no caer por
+// un hueco. Sólo mira el estado del mundo.
+static Entrada entradaHeuristica(const Mundo& m) {
+    const Jugador& j = m.jugador;
+    const float alcance = 4 * (float)m.cfg.tamanoCelda + j.radio;
+    float objetivoX = m.ancho * 0.5f, mejor = alcance * alcance;
+    for (const auto& itm : m.items) {
+        const Point2f d = itm.pos - j.pos;
+        const float   d2 = d.x * d.x + d.y * d.y;
+        if (d.y < j.radio && d2 < mejor) {
+            mejor     = d2;
+            objetivoX = itm.pos.x;
+        }
+    }
+    objetivoX = min(max(objetivoX, m.ancho * 0.4f), m.ancho * 0.6f);
+
+    const double tc = m.cfg.tamanoCelda;
+    auto conSuelo = [&](int x) {
+        for (int y = max(0, (int)(j.pos.y / tc)); y < m.filas; ++y)
+            if (m.factorTamano(x, y) > 0 && !m.enZona(x, y)) return true;
+        return false;
+    };
+    const int columna = (int)floor((objetivoX - m.origenX) / tc);
+    for (int d = 0; d <= 3; ++d) {
+        if (columna - d >= 0 && conSuelo(columna - d)) {
+            objetivoX = m.centroCelda(columna - d, 0).x;
+            break;
+        }
+        if (columna + d < m.columnas && conSuelo(columna + d)) {
+            objetivoX = m.centroCelda(columna + d, 0).x;
+            break;
+        }
+    }
+
+    Entrada e;
+    e.derecha   = j.pos.x < objetivoX - j.radio;
+    e.izquierda = j.pos.x > objetivoX + j.radio;
+    e.salto     = j.enSuelo;
+    return e;
+}
+
+// Un parámetro de ConfiguracionJuego y los valores que toma en el barrido
+struct ParametroBarrido {
+    string         nombre;
+    vector<double> valores;
+};
+
+// Asigna por nombre, convirtiendo al tipo del campo. Con un valor fuera de
+// rango (ver rangosConfiguracion) no asigna y devuelve false.
+static bool asignarParametro(ConfiguracionJuego& cfg, const string& nombre, double valor) {
+    if (!valorCampoValido(nombre, valor)) return false;
+    bool hallado = false;
+    camposConfiguracion(cfg, [&](const char* n, auto& campo) {
+        if (nombre != n) return;
+        campo   = (decay_t<decltype(campo)>)valor;
+        hallado = true;
+    });
+    return hallado;
+}
+
+// "nombre=v1,v2,..." o "nombre=desde:hasta:cuantos"
+static bool leerParametroBarrido(const string& texto, ParametroBarrido& p) {
+    const size_t igual = texto.find('=');
+    if (igual == string::npos) return false;
+    p.nombre = texto.substr(0, igual);
+    ConfiguracionJuego prueba;
+    bool hallado = false;
+    camposConfiguracion(prueba, [&](const char* n, auto&) { hallado = hallado || p.nombre == n; });
+    if (!hallado) return false;
+    const string valores = texto.substr(igual + 1);
+    double desde, hasta;
+    int    cuantos;
+    if (sscanf(valores.c_str(), "%lf:%lf:%d", &desde, &hasta, &cuantos) == 3) {
+        if (cuantos < 1) return false;
+        for (int k = 0; k < cuantos; ++k)
+            p.valores.push_back(cuantos == 1 ? desde : desde + (hasta - desde) * k / (cuantos - 1));
+    } else {
+        stringstream ss(valores);
+        for (string v; getline(ss, v, ',');) {
+            char* fin;
+            p.valores.push_back(strtod(v.c_str(), &fin));
+            if (fin == v.c_str() || *fin) return false;
+        }
+    }
+    // todos los valores se comprueban aquí: uno malo a mitad del lote lo pararía
+    for (double v : p.valores)
+        if (!asignarParametro(prueba, p.nombre, v)) {
+            cerr << "Valor fuera de rango para " << p.nombre << ": " << v << "\n";
+            return false;
+        }
+    return !p.valores.empty();
+}
+
+struct OpcionesLote {
+    string                   fichero;            // CSV con una fila por partida
+    vector<ParametroBarrido> parametros;         // producto cartesiano
+    int                      repeticiones = 8;   // semillas por combinación
+    Agente                   agente = AGENTE_HEURISTICO;
+    long                     fotogramas = 0;     // límite por partida
+};
+
+// Muestras de celdas vivas por partida, a intervalos iguales del límite
+static constexpr int muestrasVivas = 10;
+
+struct ResultadoPartida {
+    long fotogramas = 0;     // hasta la derrota o el límite
+    bool derrota    = false;
+    int  nivel      = 1, puntuacion = 0;
+    long vivas[muestrasVivas];
+    int  muestras   = 0;     // las tomadas antes de terminar
+};
+
+// Una partida hasta la primera derrota o el límite de fotogramas
+static ResultadoPartida jugarPartida(const ConfiguracionJuego& cfg, int ancho, int alto, unsigned semilla,
+                                     long limite, Agente agente) {
+    ResultadoPartida r;
+    Mundo mundo(cfg, ancho, alto, semilla);
+    const long cadaMuestra = max(1L, limite / muestrasVivas);
+    while (r.fotogramas < limite) {
+        const Entrada e = agente == AGENTE_HEURISTICO ? entradaHeuristica(mundo) : entradaGuionada(mundo);
+        r.fotogramas++;
+        if (!mundo.paso(e)) {
+            r.derrota = true;
+            break;
+        }
+        if (r.fotogramas % cadaMuestra == 0 && r.muestras < muestrasVivas)
+            r.vivas[r.muestras++] = mundo.celdasVivas();
+    }
+    r.nivel      = mundo.nivel;
+    r.puntuacion = mundo.puntuacion;
+    return r;
+}
+
+// La partida i juega la combinación i / repeticiones con la semilla
+// semilla + i % repeticiones: todas las combinaciones ven las mismas
+// semillas, y las diferencias entre ellas no son de suerte. El CSV sale en
+// orden de partida, igual con cualquier número de hilos.
+static bool ejecutarLote(const ConfiguracionJuego& base, int ancho, int alto, unsigned semilla,
+                         const OpcionesLote& op, int hilos) {
+    long combinaciones = 1;
+    for (const auto& p : op.parametros) combinaciones *= (long)p.valores.size();
+    const long total = combinaciones * op.repeticiones;
+    // Los valores de cada combinación, con el primer parámetro variando más despacio
+    auto configuracion = [&](long c) {
+        ConfiguracionJuego cfg = base;
+        for (size_t k = op.parametros.size(); k-- > 0;) {
+            const auto& p = op.parametros[k];
+            asignarParametro(cfg, p.nombre, p.valores[c % p.valores.size()]);
+            c /= (long)p.valores.size();
+        }
+        return cfg;
+    };
+
+    ofstream csv(op.fichero);
+    if (!csv) {
+        cerr << "No se puede escribir " << op.fichero << "\n";
+        return false;
+    }
+
+    vector<ResultadoPartida> resultados(total);
+    RepartoConRobo           reparto(hilos);
+    atomic<long>             terminadas{0};
+    Reloj::time_point        inicio = Reloj::now();
+    reparto.ejecutar(total, [&](long i, int w) {
+        resultados[i] = jugarPartida(configuracion(i / op.repeticiones), ancho, alto,
+                                     semilla + (unsigned)(i % op.repeticiones), op.fotogramas, op.agente);
+        const long hechas = ++terminadas;
+        if (w == 0 || hechas == total)
+            cerr << "\r" << hechas << "/" << total << " partidas" << (hechas == total ? "\n" : "") << flush;
+    });
+    const double segundos = chrono::duration<double>(Reloj::now() - inicio).count();
+
+    const long cadaMuestra = max(1L, op.fotogramas / muestrasVivas);
+    csv << "partida,semilla";
+    for (const auto& p : op.parametros) csv << "," << p.nombre;
+    csv << ",fotogramas,derrota,nivel,puntuacion";
+    for (int k = 1; k <= muestrasVivas; ++k) csv << ",vivas_" << k * cadaMuestra;
+    csv << "\n";
+    for (long i = 0; i < total; ++i) {
+        const ResultadoPartida& r = resultados[i];
+        const ConfiguracionJuego cfg = configuracion(i / op.repeticiones);
+        csv << i << "," << semilla + (unsigned)(i % op.repeticiones);
+        for (const auto& p : op.parametros)
+            camposConfiguracion(cfg, [&](const char* n, auto v) { if (p.nombre == n) csv << "," << v; });
+        csv << "," << r.fotogramas << "," << r.derrota << "," << r.nivel << "," << r.puntuacion;
+        for (int k = 0; k < muestrasVivas; ++k) {
+            csv << ",";
+            if (k < r.muestras) csv << r.vivas[k];
+        }
+        csv << "\n";
+    }
+
+    // Resumen por combinación
+    long fotogramasTotales = 0;
+    for (const auto& r : resultados) fotogramasTotales += r.fotogramas;
+    cout << fixed << setprecision(1)
+         << total << " partidas (" << combinaciones << " combinaciones × " << op.repeticiones
+         << " semillas, agente " << nombresAgente[op.agente] << ") en " << segundos << " s con "
+         << reparto.numHilos() << " hilos: " << total / max(segundos, 1e-9) << " partidas/s, "
+         << fotogramasTotales / max(segundos, 1e-9) << " fotogramas/s, "
+         << reparto.robos() << " robos\n";
+    for (long c = 0; c < combinaciones; ++c) {
+        double suma = 0, sumaCuadrados = 0, nivel = 0, puntuacion = 0;
+        int    completas = 0;
+        for (long i = c * op.repeticiones; i < (c + 1) * op.repeticiones; ++i) {
+            const double f = (double)resultados[i].fotogramas;
+            suma          += f;
+            sumaCuadrados += f * f;
+            nivel         += resultados[i].nivel;
+            puntuacion    += resultados[i].puntuacion;
+            completas     += !resultados[i].derrota;
+        }
+        const double media = suma / op.repeticiones;
+        const ConfiguracionJuego cfg = configuracion(c);
+        cout << " ";
+        if (op.parametros.empty()) cout << " configuración base";
+        for (const auto& p : op.parametros)
+            camposConfiguracion(cfg, [&](const char* n, auto v) { if (p.nombre == n) cout << " " << n << "=" << v; });
+        cout << ": supervivencia " << media << " ± "
+             << sqrt(max(0.0, sumaCuadrados / op.repeticiones - media * media))
+             << " fotogramas, nivel " << nivel / op.repeticiones << ", puntuación "
+             << puntuacion / op.repeticiones << ", " << completas << "/" << op.repeticiones
+             << " llegan al límite\n";
+    }
+    cout << "resultados en " << op.fichero << "\n";
+    return true;
+}
+
+// ======== Simulación y presentación en hilos ========
+// En la partida con ventana la simulación corre en su propio hilo a paso
+// fijo y publica instantáneas inmutables. El hilo principal, dueño de SDL,
+// presenta la más reciente interpolando entre sus dos últimos pasos, así que
+// una subida o presentación lenta ya no frena la física.
+
+// Intercambio triple sin bloqueos: el productor escribe siempre en su búfer
+// y publicar() lo cambia por el intermedio; recoger() cambia el del consumidor
+// por el intermedio si hay uno nuevo. Ninguno espera al otro y el consumidor
+// nunca ve un búfer a medio escribir.
+template <class T>
+struct BuferTriple {
+    T&       escritura()      { return bufs[escribiendo]; }
+    const T& lectura() const  { return bufs[leyendo]; }
+    void publicar() { escribiendo = intermedio.exchange(escribiendo | nuevo) & indice; }
+    bool recoger() {
+        if (!(intermedio.load() & nuevo)) return false;
+        leyendo = intermedio.exchange(leyendo) & indice;
+        return true;
+    }
+
+private:
+    static constexpr int nuevo = 4, indice = 3;
+    T           bufs[3];
+    int         escribiendo = 0, leyendo = 1;
+    atomic<int> intermedio{2};
+};
+
+// Lo necesario para dibujar un paso fuera del hilo de simulación
+struct Instantanea {
+    Mat                 fondo;               // capa de celdas del último paso (índices o BGR)
+    int                 origenFondo = 0;     // circular: ver DibujoIncremental
+    vector<vector<SDL_Rect>> celdas;         // sin fondo: rectángulos por índice de color
+    int                 ancho = 0, alto = 0;
+    vector<Recuperable> items;
+    Jugador             jugador;
+    Rotulos             rotulos;
+    int                 fotograma      = 0;  // para el parpadeo del jugador
+    int                 desplazamiento = 0;  // píxeles que avanzó el fondo en el último paso
+    float               escala         = 1;  // de coordenadas del mundo a píxeles del fondo
+    int                 tamanoCelda    = 0;  // lado de celda del mundo; cambia al restaurar una captura
+    Reloj::time_point   instante;            // hora real a la que corresponde el último paso
+    double              msDibujo       = 0;  // capa de celdas de la tanda, por paso de la tanda
+
+    // Medidas de la tanda de pasos que la produjo, si Simulacion::medir
+    bool                medida = false;
+    int                 pasos  = 0;
+    double              nsFase[NUM_FASES_MUNDO] = {};
+    Reloj::time_point   inicioTanda;
+    long                celdasVivas = 0, reglas = 0;
+};
+
+// Media, desviación y máximo de una serie de intervalos en ms
+struct EstadisticaIntervalos {
+    long   n = 0;
+    double suma = 0, sumaCuadrados = 0, maximo = 0;
+
+    void   anotar(double ms) { n++; suma += ms; sumaCuadrados += ms * ms; maximo = max(maximo, ms); }
+    double media() const      { return n ? suma / n : 0; }
+    double desviacion() const { return n ? sqrt(max(0.0, sumaCuadrados / n - media() * media())) : 0; }
+};
+
+struct Simulacion {
+    static constexpr int maxPasosSeguidos = 8;   // tras un parón más largo se descarta el resto
+
+    Mundo&                   mundo;
+    BuferTriple<Instantanea> instantaneas;
+    atomic<uint8_t>          entrada{0};          // Entrada::bits() del teclado
+    atomic<uint64_t>         tamanoPendiente{0};  // ancho << 32 | alto, 0 = sin cambios
+    atomic<int>              celdaPedida{0};      // Mundo::celdaDibujo nueva, 0 = sin cambios
+    atomic<bool>             salir{false};
+    atomic<bool>             medir{false};        // fases y contadores en cada instantánea
+    atomic<bool>             terminada{false};    // se acabó la reproducción
+    bool                     rasterizar = true;   // false: las celdas van como rectángulos
+    bool                     capaIndexada = true; // DibujoIncremental::indexada
+    Grabacion*               grabacion    = nullptr;   // anota cada paso
+    Reproduccion*            reproduccion = nullptr;   // da las teclas en vez de entrada
+    PuntosControl*           puntosControl = nullptr;  // capturas periódicas y pedidas
+    atomic<int>              capturaPedida{0};    // CAPTURA_GUARDAR o CAPTURA_RESTAURAR, 0 = nada
+
+    // Sólo las escribe el hilo de simulación; se leen tras terminarlo
+    long                  pasos = 0, lotesRecuperacion = 0, pasosDescartados = 0;
+    EstadisticaIntervalos retraso;   // cuánto tarde empezó cada tanda de pasos
+
+    explicit Simulacion(Mundo& m) : mundo(m) {}
+    void bucle();
+
+private:
+    DibujoIncremental dibujo;
+    double            nsAntes[NUM_FASES_MUNDO] = {};   // al empezar la tanda, si se mide
+    long              reglasAntes = 0;
+    Reloj::time_point inicioTanda;        // hora a la que empezó la tanda en curso
+
+    void publicar(long desplazamientoAntes, unsigned generacionAntes, int pasosTanda,
+                  Reloj::time_point instante);
+    void atenderCaptura(int pedida);
+};
+
+// Acumulador de paso fijo: el tiempo real transcurrido se consume en pasos
+// de Mundo::dt. Si va atrasada da varios pasos seguidos y luego duerme hasta
+// que toque el siguiente.
+void Simulacion::bucle() {
+    Reloj::time_point anterior = Reloj::now();
+    double acumulado = 0;
+    while (!salir) {
+        Reloj::time_point ahora = Reloj::now();
+        acumulado += chrono::duration<double>(ahora - anterior).count();
+        anterior = ahora;
+        if (acumulado > maxPasosSeguidos * Mundo::dt) {
+            const long sobran = (long)(acumulado / Mundo::dt) - maxPasosSeguidos;
+            pasosDescartados += sobran;
+            acumulado        -= sobran * Mundo::dt;
+        }
+        if (acumulado >= Mundo::dt) retraso.anotar((acumulado - Mundo::dt) * 1000);
+
+        // la resolución del dibujo cambia entre tandas, nunca a mitad. Se
+        // acota aquí: la pedida puede ser de antes de restaurar otro lado de celda
+        if (int c = celdaPedida.exchange(0)) mundo.celdaDibujo = max(1, min(c, (int)mundo.cfg.tamanoCelda));
+        mundo.medirFases = medir;
+        inicioTanda      = ahora;
+        if (mundo.medirFases) {
+            copy(mundo.nsFase, mundo.nsFase + NUM_FASES_MUNDO, nsAntes);
+            reglasAntes = mundo.reglasEvaluadas;
+        }
+        int      tanda = 0;
+        long     desplazamientoAntes = 0;
+        unsigned generacionAntes     = 0;
+        for (; acumulado >= Mundo::dt; acumulado -= Mundo::dt, ++tanda) {
+            if (reproduccion && reproduccion->terminada()) {
+                terminada = true;
+                salir     = true;
+                break;
+            }
+            uint64_t t = tamanoPendiente.exchange(0);
+            if (t && !reproduccion) {
+                mundo.redimensionar((int)(t >> 32), (int)(uint32_t)t);
+                if (grabacion) grabacion->cambioTamano(mundo.ancho, mundo.alto);
+            }
+            if (int c = capturaPedida.exchange(0)) atenderCaptura(c);
+            desplazamientoAntes = mundo.desplazamientoPixeles();
+            generacionAntes     = mundo.generacionRejilla;
+            const uint8_t teclas = reproduccion ? reproduccion->antesDelPaso(mundo) : entrada.load();
+            if (!mundo.paso(Entrada::desdeBits(teclas))) mundo.reiniciar();
+            if (grabacion)    grabacion->pasoDado(teclas, mundo);
+            if (reproduccion) reproduccion->despuesDelPaso(mundo);
+            if (puntosControl) puntosControl->pasoDado(mundo);
+            pasos++;
+        }
+        if (tanda > 1) lotesRecuperacion++;
+        if (tanda > 0)
+            publicar(desplazamientoAntes, generacionAntes, tanda,
+                     ahora - chrono::duration_cast<Reloj::duration>(chrono::duration<double>(acumulado)));
+        this_thread::sleep_for(chrono::duration<double>(Mundo::dt - acumulado));
+    }
+}
+
+// Entre dos pasos. Una grabación o una reproducción cuentan los pasos desde
+// el principio de la partida, así que con ellas no se restaura.
+void Simulacion::atenderCaptura(int pedida) {
+    if (!puntosControl) return;
+    if (pedida == CAPTURA_GUARDAR) {
+        if (!puntosControl->guardar(mundo)) cerr << "Hay otra captura escribiéndose\n";
+    } else if (grabacion || reproduccion) {
+        cerr << "No se restaura una captura grabando o reproduciendo\n";
+    } else {
+        double us;
+        if (cargarCaptura(mundo, puntosControl->fichero, &us))
+            cerr << "Captura restaurada en " << fixed << setprecision(1) << us << " µs\n";
+    }
+}
+
+void Simulacion::publicar(long desplazamientoAntes, unsigned generacionAntes, int pasosTanda,
+                          Reloj::time_point instante) {
+    Instantanea& s = instantaneas.escritura();
+    s.ancho = mundo.ancho;
+    s.alto  = mundo.alto;
+    const Reloj::time_point t0 = Reloj::now();
+    if (rasterizar) {
+        dibujo.indexada = capaIndexada;
+        dibujo.actualizar(mundo);
+        dibujo.capa.copyTo(s.fondo);
+        s.origenFondo = dibujo.origen;
+    } else {
+        s.celdas.resize(coloresHex.size());
+        for (auto& v : s.celdas) v.clear();
+        for (int x = 0; x < mundo.columnas; ++x)
+            for (int y = 0; y < mundo.filas; ++y) {
+                const Rect r = mundo.rectCelda(x, y);
+                if (r.area() > 0)
+                    s.celdas[mundo.indiceColor[mundo.indiceCelda(x, y)]].push_back({r.x, r.y, r.width, r.height});
+            }
+    }
+    const double nsDibujo = chrono::duration<double, nano>(Reloj::now() - t0).count();
+    s.msDibujo = nsDibujo * 1e-6 / max(pasosTanda, 1);
+    s.tamanoCelda = (int)mundo.cfg.tamanoCelda;
+    s.escala = mundo.escalaDibujo();
+    s.medida = mundo.medirFases;
+    s.pasos  = pasosTanda;
+    if (s.medida) {
+        mundo.nsFase[FASE_DIBUJO] += nsDibujo;
+        for (int f = 0; f < NUM_FASES_MUNDO; ++f) s.nsFase[f] = mundo.nsFase[f] - nsAntes[f];
+        s.inicioTanda = inicioTanda;
+        s.celdasVivas = mundo.celdasVivas();
+        s.reglas      = mundo.reglasEvaluadas - reglasAntes;
+    }
+    s.items.assign(mundo.items.begin(), mundo.items.end());
+    s.jugador        = mundo.jugador;
+    s.rotulos        = mundo.rotulos();
+    s.fotograma      = mundo.cuentaGlobalFotogramas - 1;
+    s.desplazamiento = mundo.generacionRejilla == generacionAntes
+                     ? (int)(mundo.desplazamientoPixeles() - desplazamientoAntes) : 0;
+    s.instante       = instante;
+    instantaneas.publicar();
+}
+
+// Fotograma en el instante alfa entre los dos últimos pasos de la
+// instantánea. El fondo se lleva hacia atrás lo que le falta por desplazarse;
+// la franja que queda libre a la izquierda repite el borde de la capa. Un
+// fondo de índices se expande a BGR en la misma pasada, y uno circular se
+// lee en dos tramos.
+static void componerFotograma(const Instantanea& s, float alfa, Mat& fotograma,
+                              CacheRotulos& rotulos, Perfil* perfil = nullptr) {
+    {
+        MedidaFase medida(perfil, FASE_COMPONER);
+        fotograma.create(s.fondo.rows, s.fondo.cols, CV_8UC3);
+        const int atras = min(s.fondo.cols, (int)lround((1 - alfa) * s.desplazamiento));
+        for (int y = 0; y < s.fondo.rows; ++y) {
+            uchar* destino = fotograma.ptr<uchar>(y);
+            copiarCircular(s.fondo, s.origenFondo, y, 0, s.fondo.cols - atras, destino + atras * 3);
+            copiarCircular(s.fondo, s.origenFondo, y, 0, atras, destino);
+        }
+        dibujarObjetos(fotograma, 0, s.items, s.jugador, s.fotograma, alfa, s.escala);
+    }
+    MedidaFase medida(perfil, FASE_ROTULOS);
+    rotulos.dibujar(fotograma, s.rotulos);
+    if (perfil && perfil->hudVisible) superponerHud(fotograma, perfil->hud());
+}
+
+// ======== Presentación ========
+// Tres formas de llevar una instantánea a la ventana, para poder compararlas:
+//  - bloqueo: se compone directamente en la memoria de la textura, que
+//    SDL_LockTexture entrega y aquí se envuelve en una cabecera Mat; no hay
+//    fotograma intermedio ni copia. Si el renderizador no deja bloquear la
+//    textura se pasa a copia.
+//  - copia: se compone en un Mat propio y se sube con SDL_UpdateTexture.
+//  - rectangulos: sin textura de fondo; las celdas se envían agrupadas por
+//    color con SDL_RenderFillRects y los círculos como tramos de una fila.
+enum ModoPresentacion { PRESENTACION_BLOQUEO, PRESENTACION_COPIA, PRESENTACION_RECTANGULOS };
+static const char* nombresPresentacion[] = { "bloqueo", "copia", "rectangulos" };
+
+struct Presentador {
+    SDL_Renderer*    renderizador;
+    ModoPresentacion modo;
+    Perfil*          perfil = nullptr;   // fases de presentación y HUD
+
+    Presentador(SDL_Renderer* r, ModoPresentacion m) : renderizador(r), modo(m) {}
+    ~Presentador() { liberar(); }
+    void presentar(const Instantanea& s, float alfa);   // todo listo para SDL_RenderPresent
+    void liberar();                                     // antes de destruir el renderizador
+
+private:
+    SDL_Texture*         textura = nullptr;
+    int                  anchoTextura = 0, altoTextura = 0;
+    Mat                  fotograma;         // modo copia
+    vector<SDL_Rect>     tramos;            // modo rectangulos: ítems y jugador
+    CacheRotulos         rotulos;
+    vector<SDL_Texture*> texturasTexto;     // modo rectangulos: una por rótulo
+    vector<unsigned>     versionesTexto;    // versión del sprite subido a cada una
+    SDL_Texture*         texturaHud = nullptr;   // modo rectangulos
+    unsigned             versionHud = 0;
+
+    void prepararTextura(int ancho, int alto);
+    void presentarRectangulos(const Instantanea& s, float alfa);
+};
+
+void Presentador::liberar() {
+    if (textura) SDL_DestroyTexture(textura);
+    for (SDL_Texture* t : texturasTexto)
+        if (t) SDL_DestroyTexture(t);
+    if (texturaHud) SDL_DestroyTexture(texturaHud);
+    textura    = nullptr;
+    texturaHud = nullptr;
+    texturasTexto.clear();
+    versionesTexto.clear();
+}
+
+// La textura se rehace cuando cambia el tamaño de las instantáneas (tras
+// redimensionar la ventana)
+void Presentador::prepararTextura(int ancho, int alto) {
+    if (textura && ancho == anchoTextura && alto == altoTextura) return;
+    if (textura) SDL_DestroyTexture(textura);
+    textura = SDL_CreateTexture(renderizador,
+                                SDL_PIXELFORMAT_BGR24,
+                                SDL_TEXTUREACCESS_STREAMING,
+                                ancho, alto);
+    anchoTextura = ancho;
+    altoTextura  = alto;
+}
+
+void Presentador::presentar(const Instantanea& s, float alfa) {
+    if (modo == PRESENTACION_RECTANGULOS) {
+        presentarRectangulos(s, alfa);
+        return;
+    }
+    prepararTextura(s.fondo.cols, s.fondo.rows);
+    if (modo == PRESENTACION_BLOQUEO) {
+        void* pixeles = nullptr;
+        int   paso    = 0;
+        bool  bloqueada;
+        {
+            MedidaFase medida(perfil, FASE_SUBIDA);
+            bloqueada = SDL_LockTexture(textura, NULL, &pixeles, &paso) == 0;
+        }
+        if (bloqueada) {
+            // La memoria bloqueada no conserva el fotograma anterior y puede
+            // ser lenta de leer: componerFotograma sólo escribe, y pisa todos
+            // los píxeles antes de dibujar encima
+            Mat destino(altoTextura, anchoTextura, CV_8UC3, pixeles, (size_t)paso);
+            componerFotograma(s, alfa, destino, rotulos, perfil);
+            MedidaFase medida(perfil, FASE_SUBIDA);
+            SDL_UnlockTexture(textura);
+        } else {
+            cerr << "SDL_LockTexture: " << SDL_GetError() << "; se sube con SDL_UpdateTexture\n";
+            modo = PRESENTACION_COPIA;
+        }
+    }
+    if (modo == PRESENTACION_COPIA) {
+        componerFotograma(s, alfa, fotograma, rotulos, perfil);
+        MedidaFase medida(perfil, FASE_SUBIDA);
+        SDL_UpdateTexture(textura, NULL, fotograma.data, (int)fotograma.step);
+    }
+    MedidaFase medida(perfil, FASE_PRESENTAR);
+    SDL_RenderClear(renderizador);
+    SDL_RenderCopy(renderizador, textura, NULL, NULL);
+}
+
+// Círculo relleno como tramos de una fila
+static void anadirCirculo(vector<SDL_Rect>& tramos, Point c, int r) {
+    for (int dy = -r; dy <= r; ++dy) {
+        const int mitad = (int)sqrt((double)(r * r - dy * dy));
+        tramos.push_back({c.x - mitad, c.y + dy, 2 * mitad + 1, 1});
+    }
+}
+
+void Presentador::presentarRectangulos(const Instantanea& s, float alfa) {
+    MedidaFase componer(perfil, FASE_COMPONER);
+    SDL_SetRenderDrawColor(renderizador, 255, 255, 255, 255);
+    SDL_RenderClear(renderizador);
+
+    // Celdas, un lote por color. El fondo se lleva hacia atrás lo que le
+    // falta por desplazarse moviendo la vista; a la izquierda queda blanco.
+    const SDL_Rect vista = {(int)lround((1 - alfa) * s.desplazamiento), 0, s.ancho, s.alto};
+    SDL_RenderSetViewport(renderizador, &vista);
+    for (size_t c = 0; c < s.celdas.size(); ++c) {
+        if (s.celdas[c].empty()) continue;
+        const Scalar& bgr = paletaBGR[c];
+        SDL_SetRenderDrawColor(renderizador, (Uint8)bgr[2], (Uint8)bgr[1], (Uint8)bgr[0], 255);
+        SDL_RenderFillRects(renderizador, s.celdas[c].data(), (int)s.celdas[c].size());
+    }
+    SDL_RenderSetViewport(renderizador, NULL);
+
+    // Ítems en un solo lote y el jugador en otro
+    tramos.clear();
+    for (const auto& itm : s.items)
+        anadirCirculo(tramos, interpolar(itm.posAnterior, itm.pos, alfa), (int)itm.radio);
+    SDL_SetRenderDrawColor(renderizador, 255, 215, 0, 255);
+    SDL_RenderFillRects(renderizador, tramos.data(), (int)tramos.size());
+    tramos.clear();
+    anadirCirculo(tramos, interpolar(s.jugador.posAnterior, s.jugador.pos, alfa), (int)s.jugador.radio);
+    const Scalar cj = colorJugador(s.jugador, s.fotograma);
+    SDL_SetRenderDrawColor(renderizador, (Uint8)cj[2], (Uint8)cj[1], (Uint8)cj[0], 255);
+    SDL_RenderFillRects(renderizador, tramos.data(), (int)tramos.size());
+    componer.terminar();
+
+    // Rótulos: el sprite de cada uno, con la máscara como alfa, en una
+    // textura que sólo se vuelve a subir cuando cambia el texto. BGRA32 tiene
+    // en memoria el mismo orden que CV_8UC4.
+    MedidaFase medidaRotulos(perfil, FASE_ROTULOS);
+    const vector<TextoRotulo> textos = textosRotulos(s.rotulos);
+    if (texturasTexto.size() < textos.size()) {
+        texturasTexto.resize(textos.size(), nullptr);
+        versionesTexto.resize(textos.size(), 0);
+    }
+    for (size_t i = 0; i < textos.size(); ++i) {
+        const SpriteTexto& sp  = rotulos.sprite(textos[i]);
+        SDL_Texture*&      tex = texturasTexto[i];
+        if (versionesTexto[i] != sp.version) {
+            if (tex) SDL_DestroyTexture(tex);
+            tex = SDL_CreateTexture(renderizador, SDL_PIXELFORMAT_BGRA32,
+                                    SDL_TEXTUREACCESS_STATIC, sp.caja.width, sp.caja.height);
+            SDL_SetTextureBlendMode(tex, SDL_BLENDMODE_BLEND);
+            SDL_UpdateTexture(tex, NULL, sp.bgra.data, (int)sp.bgra.step);
+            versionesTexto[i] = sp.version;
+        }
+        const SDL_Rect destino = {textos[i].origen.x + sp.caja.x, textos[i].origen.y + sp.caja.y,
+                                  sp.caja.width, sp.caja.height};
+        SDL_RenderCopy(renderizador, tex, NULL, &destino);
+    }
+
+    // HUD, que se vuelve a subir cuando el perfil lo redibuja
+    if (perfil && perfil->hudVisible && !perfil->hud().empty()) {
+        const Mat& panel = perfil->hud();
+        if (!texturaHud || versionHud != perfil->versionHud()) {
+            if (texturaHud) SDL_DestroyTexture(texturaHud);
+            texturaHud = SDL_CreateTexture(renderizador, SDL_PIXELFORMAT_BGR24,
+                                           SDL_TEXTUREACCESS_STATIC, panel.cols, panel.rows);
+            SDL_UpdateTexture(texturaHud, NULL, panel.data, (int)panel.step);
+            versionHud = perfil->versionHud();
+        }
+        const SDL_Rect destino = {s.ancho - panel.cols - 10, 10, panel.cols, panel.rows};
+        SDL_RenderCopy(renderizador, texturaHud, NULL, &destino);
+    }
+}
+
+// ======== Resolución dinámica ========
+// Elige el lado de celda con que se dibuja (Mundo::celdaDibujo) para que el
+// dibujo de un fotograma quepa en el presupuesto. El lado es entero, así
+// que la escala va a saltos y el dibujo incremental sigue siendo exacto; la
+// textura, más pequeña, la estira SDL_RenderCopy hasta la ventana. El coste
+// se supone proporcional al área: al pasar de un lado t a t' se espera
+// media * (t'/t)^2. Se baja en cuanto la media se pasa del presupuesto y se
+// sube sólo con holgura, y tras cada cambio se espera a que la media se
+// asiente para no oscilar.
+struct ControlResolucion {
+    int    minimo = 1, maximo = 1;   // lados de celda permitidos, en píxeles
+    int    actual = 1;
+    double presupuestoMs = 0;
+    long   cambios = 0;
+
+    ControlResolucion(int minimoCelda, int maximoCelda, double msPorFotograma)
+        : minimo(minimoCelda), maximo(maximoCelda), actual(maximoCelda),
+          presupuestoMs(0.8 * msPorFotograma) {}
+
+    // Anota el dibujo del último fotograma; devuelve el lado que toca
+    int ajustar(double ms) {
+        media = n++ ? 0.9 * media + 0.1 * ms : ms;
+        if (espera > 0) {
+            espera--;
+            return actual;
+        }
+        int nuevo = actual;
+        if (media > presupuestoMs && actual > minimo) {
+            // el lado que cabría, y al menos un paso
+            const double t = actual * sqrt(presupuestoMs / media);
+            nuevo = max(minimo, min(actual - 1, (int)t));
+            espera = esperaBajar;
+        } else if (actual < maximo) {
+            const double t = actual + 1.0;
+            if (media * (t * t) / ((double)actual * actual) < 0.7 * presupuestoMs) {
+                nuevo  = actual + 1;
+                espera = esperaSubir;
+            }
+        }
+        if (nuevo != actual) {
+            // el coste esperado al lado nuevo, para no volver a decidir con el viejo
+            media *= (double)nuevo * nuevo / ((double)actual * actual);
+            actual = nuevo;
+            cambios++;
+        }
+        return actual;
+    }
+
+private:
+    static constexpr int esperaBajar = 30, esperaSubir = 60;   // fotogramas
+    double media = 0;   // media exponencial del trabajo, en ms
+    long   n = 0;
+    int    espera = 0;
+};
+
+// Lado de celda al dibujar para una fracción de la resolución completa
+static int celdaParaEscala(int tc, double escala) {
+    return max(1, min(tc, (int)lround(tc * escala)));
+}
+
+// ======== Opciones de línea de órdenes ========
+struct Opciones {
+    bool     sinVentana = false;
+    bool     benchmark  = false;
+    bool     dibujar    = true;
+    bool     comprobarDibujo = false;
+    bool     semillaFija = false;
+    unsigned semilla    = 0;
+    long     fotogramas = 0;      // 0 = 3600 sin ventana, 600 por caso de benchmark
+    double   tamanoCelda = 0;     // 0 = el de la configuración
+    int      hilos      = 0;      // 0 = uno por núcleo
+    bool     escalado   = false;
+    ModoPresentacion presentacion = PRESENTACION_BLOQUEO;
+    bool     renderizadorSoftware = false;
+    bool     hud        = false;
+    string   perfil;              // fichero del registro por fotograma
+    FormatoPerfil formatoPerfil = PERFIL_CSV;
+    string   grabar, reproducir;  // ficheros de grabación
+    bool     tiempoReal = false;  // reproducir en la ventana
+    unsigned huellaCada = 1;
+    OpcionesExportacion exportacion;   // fichero vacío = no exportar
+    double   escala     = 1;      // fija, de la resolución del dibujo
+    bool     escalaDinamica = false;
+    double   escalaMinima = 0.5;  // con --escala-dinamica
+    OpcionesLote lote;            // fichero vacío = sin lote
+    string   captura = "automata.captura";   // F5 guarda aquí y F9 restaura
+    double   capturaCada = 0;     // segundos de partida entre capturas; 0 = sólo F5
+    string   restaurar;           // captura de la que empezar
+    bool     capaBGR    = false;  // capa de celdas en BGR, sin índices (para comparar)
+};
+
+static void mostrarUso(const char* programa) {
+    cerr << "Uso: " << programa << " [opciones]\n"
+         << "  --sin-ventana         simula sin SDL a máxima velocidad\n"
+         << "  --benchmark           mide fotogramas/s y ns por fase en varias rejillas\n"
+         << "  --semilla N           semilla del generador (por defecto, la hora)\n"
+         << "  --fotogramas N        fotogramas a simular (3600; 600 por caso de benchmark)\n"
+         << "  --tamano-celda N      lado de la celda en píxeles\n"
+         << "  --sin-dibujo          no rasteriza en modo sin ventana\n"
+         << "  --comprobar-dibujo    compara el dibujo incremental con el completo\n"
+         << "  --hilos N             hilos de trabajo (por defecto, uno por núcleo)\n"
+         << "  --escalado            mide de 1 a N hilos con celdas de 8 px (o --tamano-celda)\n"
+         << "  --presentacion M      bloqueo (por defecto), copia o rectangulos\n"
+         << "  --renderizador-software  usa el renderizador por software de SDL\n"
+         << "  --hud                 muestra los tiempos por fase (F3 lo alterna)\n"
+         << "  --perfil FICHERO      escribe un registro por fotograma\n"
+         << "  --formato-perfil F    csv (por defecto), json o chrome (traza)\n"
+         << "  --grabar FICHERO      graba semilla, configuración y teclas de la partida\n"
+         << "  --reproducir FICHERO  repite una grabación sin ventana y comprueba las huellas\n"
+         << "  --tiempo-real         con --reproducir, la repite en la ventana\n"
+         << "  --huella-cada N       pasos entre huellas al grabar (1; 0 = ninguna)\n"
+         << "  --exportar FICHERO    dibuja a paso fijo y codifica en vídeo (- = BGR24 en bruto)\n"
+         << "  --resolucion AxB      tamaño del vídeo exportado y del mundo guionado (1920x1080)\n"
+         << "  --codec XXXX          fourcc para VideoWriter (mp4v)\n"
+         << "  --cola N              fotogramas en vuelo hacia el codificador (8)\n"
+         << "  --escala F            dibuja a una fracción F de la resolución (1)\n"
+         << "  --escala-dinamica     baja la resolución del dibujo si no llega a tiempo\n"
+         << "  --escala-minima F     límite inferior de --escala-dinamica (0.5)\n"
+         << "  --lote FICHERO        juega partidas sin ventana en paralelo y escribe un CSV\n"
+         << "  --parametro P=V,V...  valores de un campo de la configuración en el lote\n"
+         << "                        (también P=desde:hasta:cuantos; se repite por campo)\n"
+         << "  --repeticiones N      semillas por combinación de parámetros (8)\n"
+         << "  --agente A            heuristico (por defecto) o guionado\n"
+         << "  --captura FICHERO     fichero de capturas (automata.captura); F5 guarda, F9 restaura\n"
+         << "  --captura-cada S      guarda una captura cada S segundos de partida\n"
+         << "  --restaurar FICHERO   empieza desde una captura\n"
+         << "  --capa-bgr            capa de celdas en BGR en vez de índices de la paleta\n";
+}
+
+static bool leerOpciones(int argc, char** argv, Opciones& op) {
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        bool hayValor = i + 1 < argc;
+        if      (a == "--sin-ventana") op.sinVentana = true;
+        else if (a == "--benchmark")   op.benchmark  = true;
+        else if (a == "--sin-dibujo")  op.dibujar    = false;
+        else if (a == "--comprobar-dibujo") op.comprobarDibujo = true;
+        else if (a == "--escalado")    op.escalado   = true;
+        else if (a == "--semilla" && hayValor) {
+            op.semilla     = (unsigned)strtoul(argv[++i], nullptr, 10);
+            op.semillaFija = true;
+        }
+        else if (a == "--fotogramas" && hayValor)   op.fotogramas  = strtol(argv[++i], nullptr, 10);
+        else if (a == "--tamano-celda" && hayValor) {
+            op.tamanoCelda = strtod(argv[++i], nullptr);
+            if (!valorCampoValido("tamanoCelda", op.tamanoCelda)) {
+                cerr << "Valor fuera de rango para tamanoCelda: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if (a == "--hilos" && hayValor)        op.hilos       = atoi(argv[++i]);
+        else if (a == "--renderizador-software")    op.renderizadorSoftware = true;
+        else if (a == "--hud")                      op.hud    = true;
+        else if (a == "--perfil" && hayValor)       op.perfil = argv[++i];
+        else if (a == "--grabar" && hayValor)       op.grabar = argv[++i];
+        else if (a == "--reproducir" && hayValor)   op.reproducir = argv[++i];
+        else if (a == "--tiempo-real")              op.tiempoReal = true;
+        else if (a == "--huella-cada" && hayValor)  op.huellaCada = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else if (a == "--exportar" && hayValor)     op.exportacion.fichero = argv[++i];
+        else if (a == "--codec" && hayValor)        op.exportacion.codec   = argv[++i];
+        else if (a == "--cola" && hayValor)         op.exportacion.capacidadCola = atoi(argv[++i]);
+        else if (a == "--escala-dinamica")          op.escalaDinamica = true;
+        else if (a == "--lote" && hayValor)         op.lote.fichero = argv[++i];
+        else if (a == "--captura" && hayValor)      op.captura = argv[++i];
+        else if (a == "--captura-cada" && hayValor) op.capturaCada = strtod(argv[++i], nullptr);
+        else if (a == "--restaurar" && hayValor)    op.restaurar = argv[++i];
+        else if (a == "--capa-bgr")                 op.capaBGR = true;
+        else if (a == "--repeticiones" && hayValor) op.lote.repeticiones = max(1, atoi(argv[++i]));
+        else if (a == "--parametro" && hayValor) {
+            ParametroBarrido p;
+            if (!leerParametroBarrido(argv[++i], p)) {
+                mostrarUso(argv[0]);
+                return false;
+            }
+            op.lote.parametros.push_back(p);
+        }
+        else if (a == "--agente" && hayValor) {
+            string g = argv[++i];
+            int k = 0;
+            while (k < 2 && g != nombresAgente[k]) ++k;
+            if (k == 2) {
+                mostrarUso(argv[0]);
+                return false;
+            }
+            op.lote.agente = (Agente)k;
+        }
+        else if ((a == "--escala" || a == "--escala-minima") && hayValor) {
+            double& e = a == "--escala" ? op.escala : op.escalaMinima;
+            e = strtod(argv[++i], nullptr);
+            if (!(e > 0 && e <= 1)) {
+                mostrarUso(argv[0]);
+                return false;
+            }
+        }
+        else if (a == "--resolucion" && hayValor) {
+            if (sscanf(argv[++i], "%dx%d", &op.exportacion.ancho, &op.exportacion.alto) != 2
+             || op.exportacion.ancho <= 0 || op.exportacion.alto <= 0) {
+                mostrarUso(argv[0]);
+                return false;
+            }
+        }
+        else if (a == "--formato-perfil" && hayValor) {
+            string f = argv[++i];
+            int k = 0;
+            while (k < 3 && f != nombresFormatoPerfil[k]) ++k;
+            if (k == 3) {
+                mostrarUso(argv[0]);
+                return false;
+            }
+            op.formatoPerfil = (FormatoPerfil)k;
+        }
+        else if (a == "--presentacion" && hayValor) {
+            string m = argv[++i];
+            int k = 0;
+            while (k < 3 && m != nombresPresentacion[k]) ++k;
+            if (k == 3) {
+                mostrarUso(argv[0]);
+                return false;
+            }
+            op.presentacion = (ModoPresentacion)k;
+        }
+        else {
+            mostrarUso(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Opciones op;
+    if (!leerOpciones(argc, argv, op)) return 1;
+
+    // Ventana y temporización
+    int ancho  = 1920;
+    int alto   = 1080;
+    const int fps    = Mundo::fps;
+
+    ConfiguracionJuego cfg;
+    if (op.tamanoCelda > 0) cfg.tamanoCelda = op.tamanoCelda;
+    unsigned semilla = op.semillaFija ? op.semilla : (unsigned)time(nullptr);
+
+    Perfil perfil;
+    if (!op.perfil.empty() && !perfil.abrir(op.perfil, op.formatoPerfil)) return 1;
+    perfil.hudVisible = op.hud;
+    perfil.activo     = perfil.hudVisible || perfil.exportando();
+
+    if (!op.lote.fichero.empty()) {
+        op.lote.fotogramas = op.fotogramas > 0 ? op.fotogramas : 36000;
+        return ejecutarLote(cfg, ancho, alto, semilla, op.lote, op.hilos) ? 0 : 1;
+    }
+
+    ReservaHilos hilos(op.hilos);
+    if (op.escalado) {
+        if (op.tamanoCelda <= 0) cfg.tamanoCelda = 8;
+        cfg.velocidadDesplazamiento = 100;
+        ejecutarEscalado(cfg, ancho, alto, semilla, op.fotogramas > 0 ? op.fotogramas : 600,
+                         hilos.numHilos());
+        return 0;
+    }
+    if (op.benchmark) {
+        ejecutarBenchmark(cfg, ancho, alto, semilla, op.fotogramas > 0 ? op.fotogramas : 600, &hilos);
+        cout << "\n";
+        ejecutarBenchmarkItems(cfg, ancho, alto, semilla, 30, &hilos);
+        return 0;
+    }
+    if (!op.exportacion.fichero.empty() && op.reproducir.empty()) {
+        OpcionesExportacion& e = op.exportacion;
+        if (e.ancho == 0) { e.ancho = ancho; e.alto = alto; }
+        e.fotogramas = op.fotogramas > 0 ? op.fotogramas : 3600;
+        return exportarVideo(cfg, semilla, e, nullptr, &hilos) ? 0 : 1;
+    }
+    if (op.sinVentana) {
+        Mundo mundo(cfg, ancho, alto, semilla);
+        mundo.hilos = &hilos;
+        double us;
+        if (!op.restaurar.empty()) {
+            if (!cargarCaptura(mundo, op.restaurar, &us)) return 1;
+            cout << "captura restaurada en " << fixed << setprecision(1) << us << " µs\n";
+        }
+        mundo.celdaDibujo = celdaParaEscala((int)mundo.cfg.tamanoCelda, op.escala);
+        PuntosControl puntos(op.captura, lround(op.capturaCada * Mundo::fps));
+        imprimirResultado(simularSinVentana(mundo, op.fotogramas > 0 ? op.fotogramas : 3600,
+                                            op.dibujar, op.comprobarDibujo,
+                                            perfil.exportando() ? &perfil : nullptr,
+                                            op.capturaCada > 0 ? &puntos : nullptr, !op.capaBGR));
+        imprimirPuntosControl(puntos, cout);
+        if (perfil.exportando()) perfil.imprimirResumen(cout);
+        perfil.cerrar();
+        return 0;
+    }
+
+    // La grabación fija semilla, configuración y tamaño del mundo
+    if (!op.restaurar.empty() && (!op.grabar.empty() || !op.reproducir.empty())) {
+        cerr << "--restaurar no se combina con --grabar ni con --reproducir\n";
+        return 1;
+    }
+    Reproduccion reproduccion;
+    if (!op.reproducir.empty()) {
+        if (!reproduccion.cargar(op.reproducir)) return 1;
+        if (!op.exportacion.fichero.empty()) {
+            OpcionesExportacion& e = op.exportacion;
+            if (e.ancho == 0) { e.ancho = reproduccion.cabecera.ancho; e.alto = reproduccion.cabecera.alto; }
+            e.fotogramas = op.fotogramas > 0 ? op.fotogramas : reproduccion.totalPasos();
+            return exportarVideo(cfg, semilla, e, &reproduccion, &hilos) ? 0 : 1;
+        }
+        if (!op.tiempoReal) return reproducirSinVentana(reproduccion, &hilos) ? 0 : 1;
+        cfg     = reproduccion.cabecera.cfg;
+        semilla = reproduccion.cabecera.semilla;
+        ancho   = reproduccion.cabecera.ancho;
+        alto    = reproduccion.cabecera.alto;
+    }
+    Grabacion grabacion;
+    if (!op.grabar.empty()) {
+        CabeceraGrabacion c;
+        c.semilla = semilla;
+        c.ancho   = ancho;
+        c.alto    = alto;
+        c.intervaloHuella = op.huellaCada;
+        c.cfg     = cfg;
+        if (!grabacion.abrir(op.grabar, c)) return 1;
+    }
+
+    // Configuración de SDL
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        cerr << "Error SDL_Init: " << SDL_GetError() << endl;
+        return 1;
+    }
+    SDL_Window*   ventana   = SDL_CreateWindow("Plataformas",
+                                              SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                              ancho, alto,
+                                              SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    SDL_Renderer* renderizador = SDL_CreateRenderer(ventana, -1, op.renderizadorSoftware
+                                                                ? SDL_RENDERER_SOFTWARE
+                                                                : SDL_RENDERER_ACCELERATED);
+
+    Mundo mundo(cfg, ancho, alto, semilla);
+    mundo.hilos = &hilos;
+    if (!op.restaurar.empty()) {
+        double us;
+        if (!cargarCaptura(mundo, op.restaurar, &us)) return 1;
+        cout << "captura restaurada en " << fixed << setprecision(1) << us << " µs\n";
+        ancho = mundo.ancho;
+        alto  = mundo.alto;
+        SDL_SetWindowSize(ventana, ancho, alto);
+    }
+    // Los rectángulos se envían ya a su tamaño: la escala sólo cuenta al rasterizar
+    const bool escalable = op.presentacion != PRESENTACION_RECTANGULOS;
+    if (escalable) mundo.celdaDibujo = celdaParaEscala((int)mundo.cfg.tamanoCelda, op.escala);
+    // Los límites dependen del lado de celda, que cambia si F9 restaura una
+    // captura con otro: entonces se rehace (ver el bucle)
+    auto controlPara = [&](int tc) {
+        const int maximo = celdaParaEscala(tc, op.escala);
+        return ControlResolucion(min(maximo, celdaParaEscala(tc, op.escalaMinima)), maximo, 1000.0 / fps);
+    };
+    int               tamanoControlado = (int)mundo.cfg.tamanoCelda;
+    ControlResolucion resolucion       = controlPara(tamanoControlado);
+    PuntosControl puntos(op.captura, lround(op.capturaCada * fps));
+    Simulacion simulacion(mundo);
+    simulacion.puntosControl = &puntos;
+    simulacion.rasterizar    = op.presentacion != PRESENTACION_RECTANGULOS;
+    simulacion.capaIndexada  = !op.capaBGR;
+    simulacion.medir         = perfil.activo;
+    if (!op.grabar.empty())     simulacion.grabacion    = &grabacion;
+    if (!op.reproducir.empty()) simulacion.reproduccion = &reproduccion;
+    thread hiloSimulacion([&] { simulacion.bucle(); });
+
+    // Presentación a su propio ritmo: cada fotograma se programa a
+    // intervalos fijos desde el anterior, no tras el trabajo más una espera
+    const chrono::duration<double> periodo(1.0 / fps);
+    Reloj::time_point     proximo = Reloj::now(), ultimaPresentacion;
+    EstadisticaIntervalos intervalos, trabajo;   // trabajo: componer y subir, sin presentar
+    long                  presentados = 0, sinNueva = 0;   // fotogramas sin instantánea nueva
+    bool                  hayInstantanea = false;
+    Presentador           presentador(renderizador, op.presentacion);
+    presentador.perfil = &perfil;
+
+    bool salir = false;
+    while (!salir) {
+        // ===== Evento e Entrada =====
+        MedidaFase medidaEntrada(&perfil, FASE_ENTRADA);
+        SDL_Event evento;
+        while (SDL_PollEvent(&evento)) {
+            if (evento.type == SDL_QUIT) {
+                salir = true;
+            } else if (evento.type == SDL_KEYDOWN && !evento.key.repeat
+                    && evento.key.keysym.scancode == SDL_SCANCODE_F3) {
+                // El perfil mide mientras el HUD está visible o se exporta
+                perfil.hudVisible = !perfil.hudVisible;
+                perfil.activo     = perfil.hudVisible || perfil.exportando();
+                simulacion.medir  = perfil.activo;
+            } else if (evento.type == SDL_KEYDOWN && !evento.key.repeat
+                    && (evento.key.keysym.scancode == SDL_SCANCODE_F5
+                     || evento.key.keysym.scancode == SDL_SCANCODE_F9)) {
+                simulacion.capturaPedida = evento.key.keysym.scancode == SDL_SCANCODE_F5
+                                         ? CAPTURA_GUARDAR : CAPTURA_RESTAURAR;
+            } else if (evento.type == SDL_WINDOWEVENT && evento.window.event == SDL_WINDOWEVENT_RESIZED) {
+                // Manejar redimensionamiento de ventana; la simulación
+                // rehace la rejilla con las nuevas dimensiones antes del
+                // siguiente paso, sin reiniciar la partida
+                ancho  = evento.window.data1;
+                alto   = evento.window.data2;
+                simulacion.tamanoPendiente = (uint64_t)ancho << 32 | (uint32_t)alto;
+            }
+        }
+        const Uint8* teclas = SDL_GetKeyboardState(NULL);
+        if (teclas[SDL_SCANCODE_ESCAPE] || simulacion.terminada) salir = true;
+        Entrada entrada;
+        entrada.izquierda = teclas[SDL_SCANCODE_A] || teclas[SDL_SCANCODE_LEFT];
+        entrada.derecha   = teclas[SDL_SCANCODE_D] || teclas[SDL_SCANCODE_RIGHT];
+        entrada.salto     = teclas[SDL_SCANCODE_W] || teclas[SDL_SCANCODE_UP];
+        simulacion.entrada = entrada.bits();
+        medidaEntrada.terminar();
+
+        // Las tandas de instantáneas que se pisan sin llegar a recogerse no
+        // se anotan en el perfil
+        const bool nueva = simulacion.instantaneas.recoger();
+        if (nueva) {
+            hayInstantanea = true;
+            const Instantanea& s = simulacion.instantaneas.lectura();
+            if (perfil.activo && s.medida)
+                perfil.anotarTanda(s.nsFase, s.inicioTanda, s.pasos, s.celdasVivas,
+                                   (long)s.items.size(), s.reglas);
+            // tras restaurar otra rejilla la escala pedida se aplica a su lado
+            // de celda y el control empieza de nuevo con sus límites
+            if (escalable && s.tamanoCelda != tamanoControlado) {
+                tamanoControlado = s.tamanoCelda;
+                resolucion       = controlPara(tamanoControlado);
+                simulacion.celdaPedida = resolucion.actual;
+            }
+        } else if (hayInstantanea) {
+            sinNueva++;
+        }
+        if (hayInstantanea) {
+            const Instantanea& s = simulacion.instantaneas.lectura();
+            Reloj::time_point t0 = Reloj::now();
+            const double alfa = chrono::duration<double>(t0 - s.instante).count() / Mundo::dt;
+            presentador.presentar(s, (float)max(0.0, min(1.0, alfa)));
+            const double msComponer = chrono::duration<double, milli>(Reloj::now() - t0).count();
+            trabajo.anotar(msComponer);
+
+            // Sólo cuenta lo que cambia con la resolución: la capa de celdas
+            // (por paso, para que las tandas de recuperación no pesen más) y
+            // componer y subir. Una instantánea repetida no aporta medida nueva.
+            if (op.escalaDinamica && escalable && nueva) {
+                const int celda = resolucion.actual;
+                if (resolucion.ajustar(s.msDibujo + msComponer) != celda)
+                    simulacion.celdaPedida = resolucion.actual;
+            }
+
+            // Renderizar
+            {
+                MedidaFase medida(&perfil, FASE_PRESENTAR);
+                SDL_RenderPresent(renderizador);
+            }
+            if (perfil.activo) perfil.cerrarFotograma();
+
+            Reloj::time_point t = Reloj::now();
+            if (presentados++ > 0)
+                intervalos.anotar(chrono::duration<double, milli>(t - ultimaPresentacion).count());
+            ultimaPresentacion = t;
+        }
+
+        proximo += chrono::duration_cast<Reloj::duration>(periodo);
+        if (proximo < Reloj::now()) proximo = Reloj::now();   // no recuperar fotogramas perdidos
+        this_thread::sleep_until(proximo);
+    }
+    simulacion.salir = true;
+    hiloSimulacion.join();
+
+    cout << fixed << setprecision(2)
+         << "presentación (" << nombresPresentacion[presentador.modo] << "): "
+         << presentados << " fotogramas, intervalo " << intervalos.media()
+         << " ms ± " << intervalos.desviacion() << ", máximo " << intervalos.maximo << " ms, "
+         << sinNueva << " sin instantánea nueva\n"
+         << "  componer y subir: " << trabajo.media() << " ms ± " << trabajo.desviacion()
+         << ", máximo " << trabajo.maximo << " ms\n"
+         << "simulación: " << simulacion.pasos << " pasos, retraso " << simulacion.retraso.media()
+         << " ms ± " << simulacion.retraso.desviacion() << ", máximo " << simulacion.retraso.maximo
+         << " ms, " << simulacion.lotesRecuperacion << " tandas de recuperación, "
+         << simulacion.pasosDescartados << " pasos descartados\n";
+    if (op.escalaDinamica && escalable)
+        cout << "resolución del dibujo: celdas de " << resolucion.actual << " de "
+             << resolucion.maximo << " px al terminar, " << resolucion.cambios << " cambios\n";
+    imprimirPuntosControl(puntos, cout);
+    perfil.imprimirResumen(cout);
+    perfil.cerrar();
+    grabacion.cerrar();
+    if (!op.grabar.empty())
+        cout << "grabados " << grabacion.pasos() << " pasos en " << op.grabar << "\n";
+    if (!op.reproducir.empty()) {
+        cout << "reproducción: " << (simulacion.terminada ? "completa" : "interrumpida") << "\n";
+        imprimirReproduccion(reproduccion);
+    }
+
+    // Limpieza
+    presentador.liberar();
+    SDL_DestroyRenderer(renderizador);
+    SDL_DestroyWindow(ventana);
+    SDL_Quit();
+    return 0;
+}